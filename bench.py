@@ -0,0 +1,139 @@
+# Benchmarks. Build with make.py first, then run one of:
+#   python3 bench.py vm       Running programs on the VM against compiling them.
+#   python3 bench.py scanner  Scanning a large generated source.
+#   python3 bench.py parser   Parsing generated sources of growing length.
+#   python3 bench.py compiler Compiling generated programs of growing length.
+import os
+import subprocess
+import sys
+import time
+
+POIBOIC = './poiboic.exe'
+RUNTIME_DIR = './runtime/'
+SRC_DIR = './poiboi_src/'
+OUT_DIR = './bench_out/'
+INT_MATH_TEST = [SRC_DIR + fname for fname in
+                 ['IntMath.poiboi', 'IntMathTables.poiboi', 'PoiCore.poiboi',
+                  'IntMath_test.poiboi']]
+GLOBAL_VARIABLE_TEST = [SRC_DIR + 'GlobalVariableTest.poiboi']
+CC_DIR = './cc_src/'
+FRONT_END_BENCH = OUT_DIR + 'front_end_bench'
+FRONT_END_BENCH_SRCS = ['front_end_bench.cc', 'ast_arena.cc', 'grammar.cc', 'parser.cc',
+                        'scanner.cc', 'source_file.cc', 'structural_index.cc']
+
+def timed(command):
+  start = time.perf_counter()
+  subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+  return time.perf_counter() - start
+
+def print_times(times):
+  width = max(len(name) for name, _ in times)
+  for name, seconds in times:
+    print(name.ljust(width) + '  %8.3fs' % seconds)
+
+# Compiled has to go through poiboic and g++ before it can run; the VM
+# starts straight from the source.
+def bench_vm():
+  os.makedirs(OUT_DIR, exist_ok=True)
+  for name, srcs in [('GlobalVariableTest', GLOBAL_VARIABLE_TEST),
+                     ('IntMath_test', INT_MATH_TEST)]:
+    cc = OUT_DIR + name + '.cc'
+    exe = OUT_DIR + name
+    poiboic = timed([POIBOIC] + srcs + [cc])
+    gxx = timed(['g++', '-std=c++20', '-O2', cc, '-I' + RUNTIME_DIR, '-L' + RUNTIME_DIR,
+                 '-lpoiboi_runtime', '-o', exe])
+    run = timed([exe])
+    vm = timed([POIBOIC, '--run'] + srcs)
+    print(name + ':')
+    print_times([('poiboic', poiboic), ('g++ -O2', gxx), ('compiled run', run),
+                 ('compiled total', poiboic + gxx + run), ('poiboic --run', vm)])
+
+def build_front_end_bench():
+  os.makedirs(OUT_DIR, exist_ok=True)
+  subprocess.run(['g++', '-std=c++20', '-O2'] + [CC_DIR + src for src in FRONT_END_BENCH_SRCS] +
+                 ['-o', FRONT_END_BENCH], check=True)
+
+# The IntMath test repeated to about 40MB. The scanner doesn't mind the
+# repeated function names.
+def write_large_source():
+  path = OUT_DIR + 'large.poiboi'
+  with open(SRC_DIR + 'IntMath_test.poiboi') as f:
+    code = f.read()
+  with open(path, 'w') as f:
+    for _ in range(40 * 1000 * 1000 // len(code)):
+      f.write(code)
+  return path
+
+def bench_scanner():
+  build_front_end_bench()
+  subprocess.run([FRONT_END_BENCH, write_large_source()], check=True)
+
+# A Main num_statements long, cycling through the kinds of statement.
+PARSER_STATEMENTS = ['  x = CONCAT(x, "a");\n',
+                     '  IF [EQUAL(x, "b")] { PRINT(x); } ELIF [y] { BREAK; } ELSE { y = x; }\n',
+                     '  WHILE [y] { y = Step(y, x, "c"); }\n',
+                     '  GLOBAL g;\n']
+
+def write_statements_source(num_statements):
+  path = OUT_DIR + 'statements_%d.poiboi' % num_statements
+  with open(path, 'w') as f:
+    f.write('Main() {\n')
+    for i in range(num_statements):
+      f.write(PARSER_STATEMENTS[i % len(PARSER_STATEMENTS)])
+    f.write('  RETURN x;\n}\n')
+  return path
+
+# Time per statement should stay flat as the sources grow.
+def bench_parser():
+  build_front_end_bench()
+  for num_statements in [25000, 50000, 100000]:
+    print('%d statements:' % num_statements)
+    subprocess.run([FRONT_END_BENCH, '--parse', write_statements_source(num_statements)],
+                   check=True)
+
+# Function names can't have digits, so functions are numbered in letters.
+def letters(n):
+  return ''.join(chr(ord('a') + int(digit)) for digit in str(n))
+
+# Each function calls the one before it, so every call resolves.
+PROGRAM_FUNCTION = """Fn%s(x, y) {
+  z = CONCAT(x, "a");
+  IF [EQUAL(z, y)] { PRINT(z); } ELIF [y] { z = Fn%s(z, y); } ELSE { y = x; }
+  WHILE [NOT(EQUAL(y, ""))] { y = SUBSTRING(y, "1", STRLEN(y)); z = CONCAT(z, y); }
+  GLOBAL g;
+  g = z;
+  RETURN z;
+}
+"""
+
+def write_program_source(num_functions):
+  path = OUT_DIR + 'program_%d.poiboi' % num_functions
+  with open(path, 'w') as f:
+    f.write('Fna(x, y) {\n  RETURN x;\n}\n')
+    for i in range(1, num_functions):
+      f.write(PROGRAM_FUNCTION % (letters(i), letters(i - 1)))
+    f.write('Main() {\n  RETURN Fn%s("a", "b");\n}\n' % letters(num_functions - 1))
+  return path
+
+# The best of 3 compiles for each stage poiboic --time reports.
+def bench_compiler():
+  os.makedirs(OUT_DIR, exist_ok=True)
+  for num_functions in [5000, 10000, 20000]:
+    src = write_program_source(num_functions)
+    best = {}
+    for _ in range(3):
+      result = subprocess.run([POIBOIC, '--time', src, OUT_DIR + 'program.cc'], check=True,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+      for line in result.stderr.splitlines():
+        stage, seconds = line.rsplit(None, 1)
+        best[stage] = min(best.get(stage, float('inf')), float(seconds.rstrip('s')))
+    print('%d functions:' % num_functions)
+    print_times(list(best.items()))
+
+BENCHMARKS = {'vm': bench_vm, 'scanner': bench_scanner, 'parser': bench_parser,
+              'compiler': bench_compiler}
+
+if len(sys.argv) != 2 or sys.argv[1] not in BENCHMARKS:
+  print('Usage: python3 bench.py ' + '|'.join(BENCHMARKS))
+  sys.exit(1)
+BENCHMARKS[sys.argv[1]]()
@@ -0,0 +1,100 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ast_arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace pbc {
+namespace {
+
+// Hands out ids for strings, the same id every time for the same string.
+struct InternTable {
+  std::mutex mutex;
+  // A deque, so strings don't move as more are added.
+  std::deque<std::string> strings;
+  std::unordered_map<std::string_view, uint32_t> ids;
+
+  uint32_t Intern(std::string_view text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = ids.find(text);
+    if (it != ids.end()) {
+      return it->second;
+    }
+    const uint32_t id = strings.size();
+    strings.emplace_back(text);
+    ids.emplace(strings.back(), id);
+    return id;
+  }
+
+  const std::string& Get(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return strings.at(id);
+  }
+};
+
+InternTable& GetFileNameTable() {
+  static InternTable* table = new InternTable;
+  return *table;
+}
+
+InternTable& GetSymbolNameTable() {
+  static InternTable* table = new InternTable;
+  return *table;
+}
+
+}  // namespace
+
+std::string_view AstArena::CopyString(std::string_view text) {
+  char* copy = static_cast<char*>(Allocate(text.size() + 1, 1));
+  std::memcpy(copy, text.data(), text.size());
+  copy[text.size()] = '\0';
+  return std::string_view(copy, text.size());
+}
+
+void* AstArena::Allocate(size_t size, size_t alignment) {
+  char* start = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(next_) + alignment - 1) & ~(alignment - 1));
+  if (next_ == nullptr || start + size > end_) {
+    // Anything too big to share a block gets one to itself.
+    const size_t block_size = std::max(kBlockSize, size + alignment);
+    blocks_.emplace_back(new char[block_size]);
+    next_ = blocks_.back().get();
+    end_ = next_ + block_size;
+    start = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(next_) + alignment - 1) & ~(alignment - 1));
+  }
+  next_ = start + size;
+  return start;
+}
+
+uint32_t InternFileName(std::string_view file_name) {
+  return GetFileNameTable().Intern(file_name);
+}
+
+const std::string& GetInternedFileName(uint32_t file_id) {
+  return GetFileNameTable().Get(file_id);
+}
+
+Symbol InternSymbol(std::string_view name) {
+  return GetSymbolNameTable().Intern(name);
+}
+
+}  // namespace pbc
@@ -0,0 +1,83 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Where parsed trees live. Each file's tree is allocated from its own arena,
+// which releases every piece at once, and pieces name their file by an id
+// rather than holding a copy of its name. Variables are likewise named by
+// interned symbols.
+
+#ifndef POIBOIC_AST_ARENA_H_
+#define POIBOIC_AST_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pbc {
+
+// Bump allocates objects which are never destroyed individually; destroying
+// the arena just frees its memory. So nothing allocated here may own memory
+// outside the arena.
+class AstArena {
+ public:
+  AstArena() = default;
+  AstArena(const AstArena&) = delete;
+  AstArena& operator=(const AstArena&) = delete;
+
+  template <typename T>
+  T* New() {
+    return new (Allocate(sizeof(T), alignof(T))) T;
+  }
+
+  template <typename T>
+  T* NewArray(size_t size) {
+    return new (Allocate(sizeof(T) * size, alignof(T))) T[size];
+  }
+
+  // Returns a copy of text followed by a NUL.
+  std::string_view CopyString(std::string_view text);
+
+ private:
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  void* Allocate(size_t size, size_t alignment);
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* next_ = nullptr;
+  char* end_ = nullptr;
+};
+
+// Returns a small id standing for file_name, the same for every call with the
+// same name. Safe to call from several threads.
+uint32_t InternFileName(std::string_view file_name);
+
+// Returns the name an id from InternFileName stands for.
+const std::string& GetInternedFileName(uint32_t file_id);
+
+// Stands for a variable name; equal names have equal symbols across every
+// file. Symbols are small and handed out in order from 0.
+using Symbol = uint32_t;
+
+// Returns the symbol for name. Safe to call from several threads.
+Symbol InternSymbol(std::string_view name);
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_AST_ARENA_H_
@@ -0,0 +1,325 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ast_cache.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "scanner.h"
+#include "tokens.h"
+
+namespace pbc {
+namespace {
+
+// Bump whenever the encoding below changes.
+constexpr char kMagic[] = "PBAST2\n";
+constexpr char kCacheSuffix[] = ".ast";
+
+constexpr uint64_t Fnv1a(uint8_t byte, uint64_t hash) {
+  return (hash ^ byte) * 0x100000001b3ULL;
+}
+
+constexpr uint64_t Fnv1a(std::string_view data, uint64_t hash) {
+  for (const char c : data) {
+    hash = Fnv1a(static_cast<uint8_t>(c), hash);
+  }
+  return hash;
+}
+
+constexpr uint64_t Fnv1a(GrammarLabel label, uint64_t hash) {
+  return Fnv1a(static_cast<uint8_t>(label), hash);
+}
+
+// Hashes everything a cached tree depends on: the encoding, the tokens and the
+// grammar. Every key includes it, so a poiboic whose grammar changed never
+// trusts trees an older one produced, while rebuilding the same grammar keeps
+// the cache.
+constexpr uint64_t HashGrammar() {
+  uint64_t hash = Fnv1a(kMagic, 0xcbf29ce484222325ULL);
+  for (size_t i = 0; i < kNumGrammarLabels; ++i) {
+    const GrammarLabel label = static_cast<GrammarLabel>(i);
+    hash = Fnv1a(label, hash);
+    hash = Fnv1a(static_cast<uint8_t>(HasVariableContent(label)), hash);
+    hash = Fnv1a(static_cast<uint8_t>(IsList(label)), hash);
+  }
+  for (const FixedToken& token : kFixedTokens) {
+    hash = Fnv1a(token.label, hash);
+    hash = Fnv1a(static_cast<uint8_t>(token.content.size()), hash);
+    hash = Fnv1a(token.content, hash);
+  }
+  for (const Production& production : kProductions) {
+    hash = Fnv1a(production.piece, hash);
+    hash = Fnv1a(production.num_children, hash);
+    for (size_t i = 0; i < production.num_children; ++i) {
+      hash = Fnv1a(production.children[i], hash);
+    }
+  }
+  return hash;
+}
+
+constexpr uint64_t kGrammarHash = HashGrammar();
+
+std::string GetCachePath(const std::string& cache_dir, const std::string& key) {
+  return cache_dir + "/" + key + kCacheSuffix;
+}
+
+// Whether child can be one of list's items once the list is flattened: a kept
+// child of one of the productions that make up the list.
+constexpr bool IsListItem(GrammarLabel list, GrammarLabel child) {
+  if (ContinuesList(list, child) ||
+      (child < GrammarLabel::MODULE && !HasVariableContent(child))) {
+    return false;
+  }
+  for (const Production& production : kProductions) {
+    if (!ContinuesList(list, production.piece)) {
+      continue;
+    }
+    for (size_t i = 0; i < production.num_children; ++i) {
+      if (production.children[i] == child) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Whether some expansion of piece has exactly num_children children.
+constexpr bool HasExpansionOfSize(GrammarLabel piece, uint64_t num_children) {
+  for (const Production& production : kProductions) {
+    if (production.piece == piece && production.num_children == num_children) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether some expansion of piece has exactly these children.
+bool IsExpansion(GrammarLabel piece, const GrammarLabel* children, size_t num_children) {
+  for (const Production& production : kProductions) {
+    if (production.piece == piece && production.num_children == num_children &&
+        std::equal(children, children + num_children, production.children)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WriteVarint(uint64_t value, std::string& out) {
+  while (value >= 0x80) {
+    out += static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+// Each piece is its label, line number, content if it varies, and number of
+// children, followed by the children.
+void WritePiece(const GrammarPiece& gp, std::string& out) {
+  const GrammarLabel label = gp.GetLabel();
+  WriteVarint(static_cast<uint64_t>(label), out);
+  WriteVarint(gp.line_number(), out);
+  if (HasVariableContent(label)) {
+    const std::string_view content = gp.GetContent();
+    WriteVarint(content.size(), out);
+    out += content;
+  }
+  WriteVarint(gp.GetChildren().size(), out);
+  for (const auto& child : gp.GetChildren()) {
+    WritePiece(*child, out);
+  }
+}
+
+class PieceReader {
+ public:
+  PieceReader(std::string_view data, uint32_t file_id, AstArena& arena)
+      : data_(data), file_id_(file_id), arena_(arena) {}
+
+  bool AtEnd() const { return pos_ == data_.size(); }
+
+  // Fills in gp, which was created for the label just read. Its children must
+  // be what the grammar allows: one of its expansions, or for a list, any
+  // number of its items.
+  bool ReadPieceBody(GrammarPiece& gp) {
+    uint64_t line_number;
+    if (!ReadVarint(line_number)) {
+      return false;
+    }
+    gp.set_line_number(line_number);
+    gp.set_file_id(file_id_);
+    if (gp.IsToken() && !ReadTokenContent(static_cast<TokenPiece&>(gp))) {
+      return false;
+    }
+    uint64_t num_children;
+    if (!ReadVarint(num_children) || num_children > data_.size() - pos_) {
+      return false;
+    }
+    if (gp.IsToken()) {
+      return num_children == 0;
+    }
+    const GrammarLabel label = gp.GetLabel();
+    const bool is_list = IsList(label);
+    if (!is_list && !HasExpansionOfSize(label, num_children)) {
+      return false;
+    }
+    GrammarLabel child_labels[Production::kMaxChildren];
+    GrammarPiece** children = arena_.NewArray<GrammarPiece*>(num_children);
+    for (uint64_t i = 0; i < num_children; ++i) {
+      GrammarLabel child_label;
+      if (!ReadLabel(child_label)) {
+        return false;
+      }
+      if (is_list ? !IsListItem(label, child_label)
+                  : !CanHaveChild(label, i, child_label)) {
+        return false;
+      }
+      if (!is_list) {
+        child_labels[i] = child_label;
+      }
+      children[i] = CreateGrammarPiece(child_label, arena_);
+      if (children[i] == nullptr || !ReadPieceBody(*children[i])) {
+        return false;
+      }
+    }
+    if (!is_list && !IsExpansion(label, child_labels, num_children)) {
+      return false;
+    }
+    gp.SetChildren(Children(children, num_children));
+    return true;
+  }
+
+  bool ReadLabel(GrammarLabel& label) {
+    uint64_t value;
+    if (!ReadVarint(value) || value > static_cast<uint64_t>(GrammarLabel::RVALUE_LIST_EXPANSION)) {
+      return false;
+    }
+    label = static_cast<GrammarLabel>(value);
+    return true;
+  }
+
+ private:
+  bool ReadVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos_ < data_.size(); shift += 7) {
+      const unsigned char byte = data_[pos_++];
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Rescans the content of tokens which have any, so invalid content is
+  // caught.
+  bool ReadTokenContent(TokenPiece& token) {
+    if (!HasVariableContent(token.GetLabel())) {
+      return true;
+    }
+    uint64_t size;
+    if (!ReadVarint(size) || size > data_.size() - pos_) {
+      return false;
+    }
+    const std::string_view content = data_.substr(pos_, size);
+    pos_ += size;
+    if (ScanTokens(content, scanned_).IsFailure() || scanned_.size() != 2 ||
+        scanned_[0].label != token.GetLabel() || scanned_[0].length != size) {
+      return false;
+    }
+    static_cast<ContentTokenPiece&>(token).set_content(arena_.CopyString(content));
+    if (token.GetLabel() == GrammarLabel::VARIABLE) {
+      static_cast<Variable&>(token).set_symbol(InternSymbol(content));
+    }
+    return true;
+  }
+
+  std::string_view data_;
+  size_t pos_ = 0;
+  uint32_t file_id_;
+  AstArena& arena_;
+  std::vector<Token> scanned_;
+};
+
+}  // namespace
+
+std::string GetAstCacheKey(std::string_view code) {
+  const uint64_t hash = Fnv1a(code, kGrammarHash);
+  char key[17];
+  snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+  return key;
+}
+
+ErrorCode LoadCachedModule(const std::string& cache_dir, const std::string& key,
+                           const std::string& file_name, Module& module) {
+  const std::string path = GetCachePath(cache_dir, key);
+  std::ifstream fh(path, std::ios_base::binary);
+  if (!fh.is_open()) {
+    return ErrorCode::Failure("No cached module: " + path);
+  }
+  const std::string data{std::istreambuf_iterator<char>(fh), std::istreambuf_iterator<char>()};
+  const std::string_view magic = kMagic;
+  if (!data.starts_with(magic)) {
+    return ErrorCode::Failure("Malformed cached module: " + path);
+  }
+  Module root;
+  PieceReader reader(std::string_view(data).substr(magic.size()), InternFileName(file_name),
+                     root.arena());
+  GrammarLabel label;
+  if (!reader.ReadLabel(label) || label != GrammarLabel::MODULE ||
+      !reader.ReadPieceBody(root) || !reader.AtEnd()) {
+    return ErrorCode::Failure("Malformed cached module: " + path);
+  }
+  module = std::move(root);
+  return ErrorCode::Success();
+}
+
+ErrorCode StoreCachedModule(const std::string& cache_dir, const std::string& key,
+                            const Module& module) {
+  std::error_code fs_error;
+  std::filesystem::create_directories(cache_dir, fs_error);
+  if (fs_error) {
+    return ErrorCode::Failure("Cannot create cache directory: " + cache_dir);
+  }
+  std::string data = kMagic;
+  WritePiece(module, data);
+  // Written aside and renamed into place, so a concurrent poiboic never reads
+  // half an entry. Each writer gets its own temporary, so two storing the same
+  // key don't interleave.
+  static std::atomic<uint64_t> num_stores{0};
+  const std::string path = GetCachePath(cache_dir, key);
+  const std::string tmp_path = path + "." + std::to_string(getpid()) + "." +
+                               std::to_string(num_stores++) + ".tmp";
+  std::ofstream out(tmp_path, std::ios_base::binary);
+  out << data;
+  out.close();
+  if (!out || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    return ErrorCode::Failure("Cannot write cached module: " + path);
+  }
+  return ErrorCode::Success();
+}
+
+}  // namespace pbc
@@ -0,0 +1,48 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// An on-disk cache of parsed modules, so unchanged files skip the scanner and
+// parser. Each entry is a compact preorder encoding of the Module tree that
+// ParseTokens produced, stored under a key hashed from the file's contents
+// and the grammar. Anything unexpected in an entry is treated as a cache
+// miss, so the worst a stale or corrupt cache does is cost a reparse.
+
+#ifndef POIBOIC_AST_CACHE_H_
+#define POIBOIC_AST_CACHE_H_
+
+#include <string>
+#include <string_view>
+
+#include "error_code.h"
+#include "grammar.h"
+
+namespace pbc {
+
+// Returns the cache key for a source file with the given contents.
+std::string GetAstCacheKey(std::string_view code);
+
+// Loads the module cached under key into module, with file_name set on every
+// piece. Fails if there's no usable entry.
+ErrorCode LoadCachedModule(const std::string& cache_dir, const std::string& key,
+                           const std::string& file_name, Module& module);
+
+// Writes module to the cache under key, creating cache_dir if needed.
+ErrorCode StoreCachedModule(const std::string& cache_dir, const std::string& key,
+                            const Module& module);
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_AST_CACHE_H_
@@ -0,0 +1,77 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ast_cache.h"
+#include "grammar.h"
+#include "parser.h"
+#include "scanner.h"
+
+namespace {
+const char kKey[] = "0123456789abcdef";
+
+std::string TestCacheDir() {
+  return (std::filesystem::temp_directory_path() / "poiboi_ast_cache_test").string();
+}
+
+// Writes data as the cache entry for kKey, then loads it.
+pbc::ErrorCode LoadEntry(const std::string& data, pbc::Module& module) {
+  const std::string cache_dir = TestCacheDir();
+  std::filesystem::create_directories(cache_dir);
+  std::ofstream out(cache_dir + "/" + kKey + ".ast", std::ios_base::binary);
+  out << data;
+  out.close();
+  return pbc::LoadCachedModule(cache_dir, kKey, "test.poiboi", module);
+}
+
+void RoundTripTest() {
+  const std::string code = "Main(a, b) {\n  c = CONCAT(a, \"b\");\n  RETURN c;\n}\n";
+  std::vector<pbc::Token> tokens;
+  assert(pbc::ScanTokens(code, tokens).IsSuccess());
+  pbc::Module parsed;
+  assert(pbc::ParseTokens(tokens, code, "test.poiboi", parsed).IsSuccess());
+  assert(pbc::StoreCachedModule(TestCacheDir(), kKey, parsed).IsSuccess());
+  pbc::Module loaded;
+  assert(pbc::LoadCachedModule(TestCacheDir(), kKey, "test.poiboi", loaded).IsSuccess());
+  assert(loaded.GetChildren().size() == 1);
+  assert(loaded.GetChildren().at(0)->GetLabel() == pbc::GrammarLabel::FUNCTION_DEFINITION);
+  assert(loaded.GetChildren().at(0)->GetChildren().size() == 5);
+}
+
+void MalformedEntryTest() {
+  using namespace std::string_literals;
+  pbc::Module module;
+  // A module holding a function definition with no children.
+  assert(LoadEntry("PBAST2\n\x15\x00\x01\x16\x00\x00"s, module).IsFailure());
+  // A module holding a quoted string.
+  assert(LoadEntry("PBAST2\n\x15\x00\x01\x10\x00\x01\"\x00"s, module).IsFailure());
+  // A module holding nothing at all is an empty file.
+  assert(LoadEntry("PBAST2\n\x15\x00\x00"s, module).IsSuccess());
+  assert(module.GetChildren().size() == 0);
+}
+}  // namespace
+
+int main() {
+  RoundTripTest();
+  MalformedEntryTest();
+  std::filesystem::remove_all(TestCacheDir());
+  return 0;
+}
@@ -0,0 +1,174 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "builtins.h"
+
+#include <bit>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+#include "tokens.h"
+
+namespace pbc {
+namespace {
+
+// FNV-1a, with the seed mixed into the starting state.
+uint32_t HashName(std::string_view name, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+  for (const char c : name) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 16777619u;
+  }
+  return hash ^ (hash >> 15);
+}
+
+bool IsValidBuiltinName(std::string_view name) {
+  if (name.empty()) {
+    return false;
+  }
+  for (const char c : name) {
+    if (!IsUpperCaseLetter(c)) {
+      return false;
+    }
+  }
+  // Keywords scan as themselves, so a builtin named like one can't be called.
+  for (const FixedToken& token : kFixedTokens) {
+    if (token.content == name) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IsValidCppName(std::string_view name) {
+  if (name.empty() || (name[0] >= '0' && name[0] <= '9')) {
+    return false;
+  }
+  for (const char c : name) {
+    if (!IsUpperCaseLetter(c) && !IsLowerCaseLetter(c) && !(c >= '0' && c <= '9') &&
+        c != '_' && c != ':') {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+BuiltinRegistry::BuiltinRegistry()
+    : builtins_(std::begin(kCoreBuiltins), std::end(kCoreBuiltins)) {
+  BuildSlots();
+}
+
+ErrorOr<BuiltinRegistry> BuiltinRegistry::Load(const std::string& file_name) {
+  std::ifstream fh(file_name);
+  if (!fh.is_open()) {
+    return ErrorCode::Failure("Cannot open builtins file: " + file_name);
+  }
+  BuiltinRegistry registry;
+  std::unordered_set<std::string_view> names;
+  for (const NativeBuiltin& builtin : kCoreBuiltins) {
+    names.insert(builtin.name);
+  }
+  std::string line;
+  size_t line_num = 0;
+  while (std::getline(fh, line)) {
+    ++line_num;
+    const std::string where = "Builtins file: " + file_name + "; line: " +
+                              std::to_string(line_num) + "; ";
+    std::istringstream words(line);
+    std::string name;
+    if (!(words >> name) || name.starts_with('#')) {
+      continue;
+    }
+    if (name == "include") {
+      std::string header;
+      if (!(words >> header) || header.size() < 3 ||
+          !((header.front() == '"' && header.back() == '"') ||
+            (header.front() == '<' && header.back() == '>'))) {
+        return ErrorCode::Failure(where + "Expected a quoted header: " + line);
+      }
+      registry.headers_.push_back(std::move(header));
+      continue;
+    }
+    std::string num_args;
+    std::string cpp_name;
+    std::string purity;
+    int num_args_value = -1;
+    if (!(words >> num_args >> cpp_name) ||
+        std::from_chars(num_args.data(), num_args.data() + num_args.size(),
+                        num_args_value).ptr != num_args.data() + num_args.size() ||
+        num_args_value < 0) {
+      return ErrorCode::Failure(where + "Expected NAME NUM_ARGS CPP_NAME [pure]: " + line);
+    }
+    const bool is_pure = static_cast<bool>(words >> purity);
+    if ((is_pure && purity != "pure") || words >> purity) {
+      return ErrorCode::Failure(where + "Expected NAME NUM_ARGS CPP_NAME [pure]: " + line);
+    }
+    if (!IsValidBuiltinName(name)) {
+      return ErrorCode::Failure(where + "Builtin names are capital letters, and not a keyword: " +
+                                name);
+    }
+    if (!IsValidCppName(cpp_name)) {
+      return ErrorCode::Failure(where + "Invalid C++ function name: " + cpp_name);
+    }
+    const std::string& stored_name = registry.strings_.emplace_back(std::move(name));
+    if (!names.insert(stored_name).second) {
+      return ErrorCode::Failure(where + "Builtin defined twice: " + stored_name);
+    }
+    const std::string& stored_cpp_name = registry.strings_.emplace_back(std::move(cpp_name));
+    registry.builtins_.push_back(NativeBuiltin{.name = stored_name,
+                                               .num_args = num_args_value,
+                                               .cpp_name = stored_cpp_name,
+                                               .is_pure = is_pure,
+                                               .type = BuiltinType::NATIVE});
+  }
+  registry.BuildSlots();
+  return registry;
+}
+
+const NativeBuiltin* BuiltinRegistry::Find(std::string_view name) const {
+  const uint32_t index = slots_[HashName(name, seed_) & (slots_.size() - 1)];
+  if (index == 0 || builtins_[index - 1].name != name) {
+    return nullptr;
+  }
+  return &builtins_[index - 1];
+}
+
+void BuiltinRegistry::BuildSlots() {
+  // At most half full, so a seed without collisions turns up quickly. Too
+  // many tries grows the table instead.
+  size_t num_slots = std::bit_ceil(2 * builtins_.size());
+  for (seed_ = 0;; ++seed_) {
+    if (seed_ != 0 && seed_ % 64 == 0) {
+      num_slots *= 2;
+    }
+    slots_.assign(num_slots, 0);
+    bool has_collision = false;
+    for (uint32_t i = 0; i < builtins_.size() && !has_collision; ++i) {
+      uint32_t& slot = slots_[HashName(builtins_[i].name, seed_) & (num_slots - 1)];
+      has_collision = slot != 0;
+      slot = i + 1;
+    }
+    if (!has_collision) {
+      return;
+    }
+  }
+}
+
+}  // namespace pbc
@@ -0,0 +1,112 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// The builtin functions programs can call, like CONCAT. Each is a C++
+// function taking and returning PBStrings. The core ones are in the runtime;
+// a builtins file adds more, so native kernels can be called from PoiBoi
+// without changing the compiler.
+//
+// A builtins file has one entry per line:
+//   include "kernels.h"
+//   REVERSE 1 Kernel_Reverse pure
+// An include line names a header for generated code to include, after the
+// runtime so it can use PBString. Other lines give a builtin's name, how many
+// arguments it takes, the C++ function it calls, and "pure" if it has no side
+// effects. Blank lines and lines starting with # are skipped. Builtins from a
+// file can't be run on the VM.
+
+#ifndef POIBOIC_BUILTINS_H_
+#define POIBOIC_BUILTINS_H_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "error_code.h"
+
+namespace pbc {
+
+enum class BuiltinType {
+  EQUAL,
+  PRINT,
+  CONCAT,
+  NOT,
+  AND,
+  OR,
+  STRLEN,
+  SUBSTRING,
+  // From a builtins file.
+  NATIVE,
+};
+
+struct NativeBuiltin {
+  std::string_view name;
+  int num_args;
+  std::string_view cpp_name;
+  // No side effects, so a call whose result is unused can be dropped.
+  bool is_pure;
+  BuiltinType type;
+};
+
+inline constexpr NativeBuiltin kCoreBuiltins[] = {
+    {"EQUAL", 2, "Builtin_Equal", true, BuiltinType::EQUAL},
+    {"PRINT", 1, "Builtin_Print", false, BuiltinType::PRINT},
+    {"CONCAT", 2, "Builtin_Concat", true, BuiltinType::CONCAT},
+    {"NOT", 1, "Builtin_Not", true, BuiltinType::NOT},
+    {"AND", 2, "Builtin_And", true, BuiltinType::AND},
+    {"OR", 2, "Builtin_Or", true, BuiltinType::OR},
+    {"STRLEN", 1, "Builtin_Strlen", true, BuiltinType::STRLEN},
+    {"SUBSTRING", 3, "Builtin_Substring", true, BuiltinType::SUBSTRING},
+};
+
+// Looks builtins up by name through a perfect hash: every name has a slot of
+// its own, so a lookup hashes once and compares one name.
+class BuiltinRegistry {
+ public:
+  // Only the core builtins.
+  BuiltinRegistry();
+  // Builtins point into the registry's own strings.
+  BuiltinRegistry(const BuiltinRegistry&) = delete;
+  BuiltinRegistry& operator=(const BuiltinRegistry&) = delete;
+  BuiltinRegistry(BuiltinRegistry&&) = default;
+  BuiltinRegistry& operator=(BuiltinRegistry&&) = default;
+
+  // The core builtins plus those in a builtins file.
+  static ErrorOr<BuiltinRegistry> Load(const std::string& file_name);
+
+  // Null if no builtin is called name.
+  const NativeBuiltin* Find(std::string_view name) const;
+
+  // What the builtins file includes, quotes or brackets and all.
+  const std::vector<std::string>& headers() const { return headers_; }
+
+ private:
+  void BuildSlots();
+
+  // Backs the names of builtins from a file. A deque, so they don't move.
+  std::deque<std::string> strings_;
+  std::vector<NativeBuiltin> builtins_;
+  std::vector<std::string> headers_;
+  // Index into builtins_ plus one, or 0 for an empty slot. A power of two long.
+  std::vector<uint32_t> slots_;
+  uint32_t seed_ = 0;
+};
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_BUILTINS_H_
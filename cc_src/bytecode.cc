@@ -0,0 +1,197 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "bytecode.h"
+
+#include <cassert>
+
+namespace pbc {
+namespace {
+
+int HexDigitValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Compiled programs hand string literals to the C++ compiler as they are, so
+// escape sequences mean what they mean in C++.
+std::string DecodeStringLiteral(const std::string& literal) {
+  assert(literal.size() >= 2 && literal.front() == '"' && literal.back() == '"');
+  std::string decoded;
+  const size_t end = literal.size() - 1;
+  for (size_t i = 1; i < end; ++i) {
+    if (literal[i] != '\\' || i + 1 == end) {
+      decoded += literal[i];
+      continue;
+    }
+    const char c = literal[++i];
+    switch (c) {
+      case 'n': decoded += '\n'; break;
+      case 't': decoded += '\t'; break;
+      case 'r': decoded += '\r'; break;
+      case 'a': decoded += '\a'; break;
+      case 'b': decoded += '\b'; break;
+      case 'f': decoded += '\f'; break;
+      case 'v': decoded += '\v'; break;
+      case 'x': {
+        int value = 0;
+        while (i + 1 < end && HexDigitValue(literal[i + 1]) >= 0) {
+          value = value * 16 + HexDigitValue(literal[++i]);
+        }
+        decoded += static_cast<char>(value);
+        break;
+      }
+      default:
+        if (c >= '0' && c <= '7') {
+          int value = c - '0';
+          for (int digits = 1; digits < 3 && i + 1 < end &&
+               literal[i + 1] >= '0' && literal[i + 1] <= '7'; ++digits) {
+            value = value * 8 + literal[++i] - '0';
+          }
+          decoded += static_cast<char>(value);
+        } else {
+          // \\, \", \' and \?, and whatever GCC lets through unknown escapes.
+          decoded += c;
+        }
+    }
+  }
+  return decoded;
+}
+
+}  // namespace
+
+BytecodeBuilder::BytecodeBuilder(const std::vector<std::string>& function_names,
+                                 const std::vector<std::string>& global_names) {
+  for (uint32_t i = 0; i < function_names.size(); ++i) {
+    function_ids_[function_names[i]] = i;
+  }
+  for (uint32_t i = 0; i < global_names.size(); ++i) {
+    global_ids_[global_names[i]] = i;
+  }
+  program_.globals = global_names;
+  program_.functions.reserve(function_names.size());
+}
+
+void BytecodeBuilder::StartFunction(const std::string& name, const std::vector<std::string>& args,
+                                    const std::vector<std::string>& other_locals) {
+  assert(function_ == nullptr);
+  function_ = &program_.functions.emplace_back();
+  function_->name = name;
+  function_->num_args = args.size();
+  local_registers_.clear();
+  num_locals_ = 0;
+  for (const auto* names : {&args, &other_locals}) {
+    for (const std::string& local : *names) {
+      if (local_registers_.emplace(local, num_locals_).second) {
+        ++num_locals_;
+      }
+    }
+  }
+  function_->num_registers = num_locals_;
+  num_temporaries_ = 0;
+  if (name == "Main") {
+    program_.main_function = program_.functions.size() - 1;
+  }
+}
+
+void BytecodeBuilder::FinishFunction() {
+  assert(function_ != nullptr && loop_breaks_.empty());
+  Emit(Opcode::RETURN_EMPTY);
+  function_ = nullptr;
+}
+
+BytecodeProgram BytecodeBuilder::TakeProgram() {
+  assert(function_ == nullptr);
+  return std::move(program_);
+}
+
+uint32_t BytecodeBuilder::LocalRegister(const std::string& name) const {
+  return local_registers_.at(name);
+}
+
+uint32_t BytecodeBuilder::NewTemporary() {
+  const uint32_t reg = num_locals_ + num_temporaries_++;
+  if (reg >= function_->num_registers) {
+    function_->num_registers = reg + 1;
+  }
+  return reg;
+}
+
+uint32_t BytecodeBuilder::NewTemporaries(uint32_t count) {
+  const uint32_t first = num_locals_ + num_temporaries_;
+  for (uint32_t i = 0; i < count; ++i) {
+    NewTemporary();
+  }
+  return first;
+}
+
+void BytecodeBuilder::ReleaseTemporaries() {
+  num_temporaries_ = 0;
+}
+
+uint32_t BytecodeBuilder::ConstantId(const std::string& literal) {
+  const auto [it, inserted] = constant_ids_.emplace(literal, program_.constants.size());
+  if (inserted) {
+    program_.constants.push_back(DecodeStringLiteral(literal));
+  }
+  return it->second;
+}
+
+uint32_t BytecodeBuilder::GlobalId(const std::string& name) const {
+  return global_ids_.at(name);
+}
+
+uint32_t BytecodeBuilder::FunctionId(const std::string& name) const {
+  return function_ids_.at(name);
+}
+
+size_t BytecodeBuilder::Emit(Opcode op, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+  function_->code.push_back(Instruction{.op = op, .a = a, .b = b, .c = c, .d = d});
+  return function_->code.size() - 1;
+}
+
+size_t BytecodeBuilder::NextInstruction() const {
+  return function_->code.size();
+}
+
+void BytecodeBuilder::SetJumpTarget(size_t jump, size_t target) {
+  Instruction& instruction = function_->code.at(jump);
+  assert(instruction.op == Opcode::JUMP || instruction.op == Opcode::JUMP_IF_FALSE);
+  instruction.a = target;
+}
+
+void BytecodeBuilder::StartLoop() {
+  loop_breaks_.emplace_back();
+}
+
+void BytecodeBuilder::AddBreak(size_t jump) {
+  loop_breaks_.back().push_back(jump);
+}
+
+void BytecodeBuilder::FinishLoop(size_t end) {
+  for (const size_t jump : loop_breaks_.back()) {
+    SetJumpTarget(jump, end);
+  }
+  loop_breaks_.pop_back();
+}
+
+}  // namespace pbc
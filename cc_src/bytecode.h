@@ -0,0 +1,132 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// A register-based bytecode for PoiBoi, lowered from the evaluators, which
+// vm.h runs without a round trip through a C++ compiler.
+//
+// Every function has a fixed set of registers: its arguments first, then its
+// other local variables, then temporaries for intermediate values. An
+// instruction names its registers, constants, globals or functions by index.
+
+#ifndef POIBOIC_BYTECODE_H_
+#define POIBOIC_BYTECODE_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pbc {
+
+// a, b, c and d are an instruction's operands.
+enum class Opcode : uint8_t {
+  LOAD_CONSTANT,  // a = constants[b]
+  LOAD_GLOBAL,  // a = globals[b]
+  STORE_GLOBAL,  // globals[a] = b
+  MOVE,  // a = b
+  CALL,  // a = functions[b](c, c + 1, ..., c + d - 1)
+  EQUAL,  // a = EQUAL(b, c)
+  PRINT,  // a = PRINT(b)
+  CONCAT,  // a = CONCAT(b, c)
+  NOT,  // a = NOT(b)
+  AND,  // a = AND(b, c)
+  OR,  // a = OR(b, c)
+  STRLEN,  // a = STRLEN(b)
+  SUBSTRING,  // a = SUBSTRING(b, c, d)
+  JUMP,  // Continue from instruction a.
+  JUMP_IF_FALSE,  // Continue from instruction a unless b is TRUE.
+  RETURN,  // Return a.
+  RETURN_EMPTY,  // Return the empty string.
+};
+
+struct Instruction {
+  Opcode op;
+  uint32_t a = 0;
+  uint32_t b = 0;
+  uint32_t c = 0;
+  uint32_t d = 0;
+};
+
+struct BytecodeFunction {
+  std::string name;
+  uint32_t num_args = 0;
+  uint32_t num_registers = 0;
+  std::vector<Instruction> code;
+};
+
+struct BytecodeProgram {
+  // The contents of every string literal, escape sequences resolved.
+  std::vector<std::string> constants;
+  std::vector<std::string> globals;
+  std::vector<BytecodeFunction> functions;
+  uint32_t main_function = 0;
+};
+
+// Builds a BytecodeProgram a function at a time. The evaluators call into
+// this to lower themselves.
+class BytecodeBuilder {
+ public:
+  // Fixes the ids that CALL and the global instructions refer to.
+  BytecodeBuilder(const std::vector<std::string>& function_names,
+                  const std::vector<std::string>& global_names);
+
+  // Every local a function could assign has a register for the whole
+  // function, so other_locals must cover all of them.
+  void StartFunction(const std::string& name, const std::vector<std::string>& args,
+                     const std::vector<std::string>& other_locals);
+  void FinishFunction();
+  BytecodeProgram TakeProgram();
+
+  uint32_t LocalRegister(const std::string& name) const;
+  // Temporaries only live until ReleaseTemporaries(), which is called
+  // between statements.
+  uint32_t NewTemporary();
+  // Returns the first of count consecutive temporaries.
+  uint32_t NewTemporaries(uint32_t count);
+  void ReleaseTemporaries();
+
+  // literal is a QuotedString's content, quotes and escapes included.
+  uint32_t ConstantId(const std::string& literal);
+  uint32_t GlobalId(const std::string& name) const;
+  uint32_t FunctionId(const std::string& name) const;
+
+  // Returns the index of the emitted instruction.
+  size_t Emit(Opcode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0);
+  size_t NextInstruction() const;
+  // Points the JUMP or JUMP_IF_FALSE at index jump to target.
+  void SetJumpTarget(size_t jump, size_t target);
+
+  // BREAKs jump to wherever the innermost loop is finished.
+  void StartLoop();
+  void AddBreak(size_t jump);
+  void FinishLoop(size_t end);
+
+ private:
+  BytecodeProgram program_;
+  std::unordered_map<std::string, uint32_t> function_ids_;
+  std::unordered_map<std::string, uint32_t> global_ids_;
+  std::unordered_map<std::string, uint32_t> constant_ids_;
+  // Of the function being built.
+  BytecodeFunction* function_{};
+  std::unordered_map<std::string, uint32_t> local_registers_;
+  uint32_t num_locals_ = 0;
+  uint32_t num_temporaries_ = 0;
+  std::vector<std::vector<size_t>> loop_breaks_;
+};
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_BYTECODE_H_
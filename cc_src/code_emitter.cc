@@ -0,0 +1,49 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "code_emitter.h"
+
+namespace pbc {
+namespace {
+
+constexpr size_t kFlushThreshold = 1 << 16;
+
+}  // namespace
+
+CodeEmitter& CodeEmitter::operator<<(std::string_view code) {
+  if (string_out_ != nullptr) {
+    string_out_->append(code);
+    return *this;
+  }
+  buffer_.append(code);
+  if (buffer_.size() >= kFlushThreshold) {
+    Flush();
+  }
+  return *this;
+}
+
+CodeEmitter& CodeEmitter::operator<<(char c) {
+  return *this << std::string_view(&c, 1);
+}
+
+void CodeEmitter::Flush() {
+  if (stream_ != nullptr && !buffer_.empty()) {
+    stream_->write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+}
+
+}  // namespace pbc
@@ -0,0 +1,52 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef POIBOIC_CODE_EMITTER_H_
+#define POIBOIC_CODE_EMITTER_H_
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace pbc {
+
+// Sink that generated code is written into piece by piece, so nothing needs
+// to build up and copy strings for whole functions or files.
+class CodeEmitter {
+ public:
+  // Streams into out, a buffer at a time.
+  explicit CodeEmitter(std::ostream& out) : stream_(&out) {}
+  // Appends to out.
+  explicit CodeEmitter(std::string& out) : string_out_(&out) {}
+  CodeEmitter(const CodeEmitter&) = delete;
+  CodeEmitter& operator=(const CodeEmitter&) = delete;
+  ~CodeEmitter() { Flush(); }
+
+  CodeEmitter& operator<<(std::string_view code);
+  CodeEmitter& operator<<(char c);
+
+  // Writes out anything buffered.
+  void Flush();
+
+ private:
+  std::ostream* stream_{};
+  std::string* string_out_{};
+  std::string buffer_;
+};
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_CODE_EMITTER_H_
@@ -17,8 +17,21 @@ limitations under the License.
 namespace pbc {
 
 constexpr char kPbStringType[] = "PBString ";
+constexpr char kSizeType[] = "size_t ";
+constexpr char kPbStringArgumentType[] = "const PBString& ";
 constexpr char kFnSuffix[] = "_poiboi_fn";
+// A shared object's trampoline into a function, listed in its entry table.
+constexpr char kEntrySuffix[] = "_poiboi_entry";
 constexpr char kLocalVarSuffix[] = "_local_poiboivar";
 constexpr char kGlobalVarSuffix[] = "_global_poiboivar";
+// A shared object's globals are members of kGlobalsType, one per context,
+// pointed to by kGlobalsPointer while that context calls in.
+constexpr char kGlobalsType[] = "PoiBoiGlobals";
+constexpr char kGlobalsPointer[] = "_poiboi_globals";
+// Arguments which are reassigned are received under this name. Their local
+// variable is a pointer to either the argument or the storage below, which
+// is only written to on reassignment.
+constexpr char kArgumentSuffix[] = "_poiboiarg";
+constexpr char kArgumentStorageSuffix[] = "_poiboiargstorage";
 
 }  // namespace pbc
@@ -17,115 +17,612 @@ limitations under the License.
 #include "codegen.h"
 
 #include <algorithm>
+#include <memory>
+#include <optional>
 #include <string>
+#include <utility>
 #include <fstream>
 #include <streambuf>
 
+#include "builtins.h"
 #include "code_suffices.h"
 #include "evaluator.h"
 #include "function.h"
 #include "interpretation_context.h"
+#include "parallel.h"
+#include "profile.h"
+#include "variable_analysis.h"
 
 namespace pbc {
 namespace {
 
-void AddPBStringSrc(std::string& code_out) {
-  std::ifstream fh("cc_src/poiboi_string.h");
+constexpr char kRuntimeHeader[] = "poiboi_string.h";
+constexpr char kRuntimeSource[] = "poiboi_string.cc";
+constexpr char kModuleHeader[] = "poiboi_module.h";
+constexpr char kRuntimeLibrary[] = "poiboi_runtime";
+constexpr char kReleaseSuffix[] = "_release";
+constexpr char kLtoSuffix[] = "_lto";
+// When emitting in parallel, how many functions each thread gets at a time.
+constexpr size_t kFunctionsPerThreadBatch = 64;
+
+ErrorCode AddRuntimeFile(const std::string& runtime_dir, const char* file_name,
+                         std::string& code_out) {
+  const std::string path = runtime_dir + "/" + file_name;
+  std::ifstream fh(path);
+  if (!fh.is_open()) {
+    return ErrorCode::Failure("Cannot open runtime file: " + path);
+  }
   code_out.insert(code_out.end(), (std::istreambuf_iterator<char>(fh)),
                   std::istreambuf_iterator<char>());
-  std::ifstream fc("cc_src/poiboi_string.cc");
-  code_out.insert(code_out.end(), (std::istreambuf_iterator<char>(fc)),
-                  std::istreambuf_iterator<char>());
+  return ErrorCode::Success();
+}
+
+bool IsReleaseBuild(const CodegenOptions& options) {
+  return options.optimization_level >= 3;
+}
 
+// Code giving access to the runtime, either by including its header or by
+// pasting in all of its source.
+ErrorCode GetPBStringSrc(const CodegenOptions& options, std::string& code_out) {
+  code_out = IsReleaseBuild(options) ? "#define POIBOI_RELEASE_\n" : "";
+  if (!options.embed_runtime) {
+    code_out += std::string("#include \"") + kRuntimeHeader + "\"\n";
+    if (options.shared_library) {
+      code_out += std::string("#include \"") + kModuleHeader + "\"\n";
+    }
+    return ErrorCode::Success();
+  }
+  code_out += "#define POIBOI_EXECUTABLE_\n";
+  RETURN_EC_IF_FAILURE(AddRuntimeFile(options.runtime_dir, kRuntimeHeader, code_out));
+  RETURN_EC_IF_FAILURE(AddRuntimeFile(options.runtime_dir, kRuntimeSource, code_out));
+  if (options.shared_library) {
+    RETURN_EC_IF_FAILURE(AddRuntimeFile(options.runtime_dir, kModuleHeader, code_out));
+  }
+  return ErrorCode::Success();
 }
 
-std::string GetFunctionDeclaration(const Function& fn) {
+// Arguments are taken by const reference. Any in reassigned_arguments get a
+// different name, since their local variable is declared in the body.
+std::string GetFunctionDeclaration(
+    const Function& fn, const std::unordered_set<std::string>& reassigned_arguments = {}) {
   std::string code = kPbStringType + fn.GetName() + kFnSuffix + "(";
-  if (fn.GetVariablesList().size() > 0) {
-    code += kPbStringType + fn.GetVariablesList()[0] + kLocalVarSuffix;
-    for (int i = 1; i < fn.GetVariablesList().size(); ++i) {
-      code += ", " + (kPbStringType + fn.GetVariablesList()[i]) + kLocalVarSuffix;
+  for (size_t i = 0; i < fn.GetVariablesList().size(); ++i) {
+    const std::string& input_var = fn.GetVariablesList()[i];
+    if (i != 0) {
+      code += ", ";
     }
+    code += kPbStringArgumentType + input_var;
+    code += reassigned_arguments.count(input_var) == 1 ? kArgumentSuffix : kLocalVarSuffix;
   }
   code += ")";
   return code;
 }
 
-ErrorCode GetFunctionDefinition(const Function& fn, CompilationContext& context,
-                                std::string& code) {
-  code = GetFunctionDeclaration(fn) + "{\n";
+// Marks functions hot or cold by how often they ran, which steers GCC's
+// inlining and code layout.
+std::string GetFunctionAttributes(const Function& fn, const Profile& profile) {
+  const uint64_t calls = profile.GetCount(fn.GetName() + "/call");
+  const uint64_t total_calls = profile.GetTotalFunctionCalls();
+  if (total_calls == 0) {
+    return "";
+  }
+  if (calls == 0) {
+    return "[[gnu::cold]] ";
+  }
+  if (calls * 100 >= total_calls) {
+    return "[[gnu::hot]] ";
+  }
+  return "";
+}
+
+// A function which has been checked and is ready to emit.
+struct AnalyzedFunction {
+  const Function* fn;
+  std::unordered_set<std::string> reassigned_arguments;
+  // Null unless instrumenting or using a profile.
+  FunctionProfile* profile;
+  int call_counter;
+  CodeBlockEvaluator body;
+};
+
+ErrorOr<AnalyzedFunction> AnalyzeFunction(const Function& fn, CompilationContext& context,
+                                          FunctionProfile* profile) {
+  const VariableAssignments assignments = CollectVariableAssignments(fn.GetCode());
+  std::unordered_set<std::string> reassigned_arguments;
+  ScopedSymbolTable::Scope arguments(*context.symbols);
+  for (const Symbol symbol : fn.GetVariableSymbols()) {
+    context.symbols->Bind(symbol, Binding::LOCAL);
+  }
   for (const std::string& input_var : fn.GetVariablesList()) {
-    context.curr_local_variables.insert(input_var);
+    if (assignments.assignments.count(input_var) == 1) {
+      reassigned_arguments.insert(input_var);
+    }
+  }
+  context.reassigned_arguments = &reassigned_arguments;
+  const std::unordered_set<std::string> size_variables = InferSizeVariables(fn, assignments);
+  context.size_variables = &size_variables;
+  context.profile = profile;
+  int call_counter = -1;
+  if (profile != nullptr) {
+    call_counter = profile->AddCounter("call");
   }
 
-  const auto evaluator = CodeBlockEvaluator::TryCreate(fn.GetCode(), context);
+  auto evaluator = CodeBlockEvaluator::TryCreate(fn.GetCode(), context);
+  context.size_variables = nullptr;
+  context.reassigned_arguments = nullptr;
+  context.profile = nullptr;
   RETURN_EC_IF_FAILURE(evaluator);
-  code += evaluator.GetItem().GetCode() + "\nreturn PBString();\n}\n\n\n";
-  context.curr_local_variables = {};
-  return ErrorCode::Success();
+  return AnalyzedFunction{.fn = &fn,
+                          .reassigned_arguments = std::move(reassigned_arguments),
+                          .profile = profile,
+                          .call_counter = call_counter,
+                          .body = std::move(evaluator.GetItem())};
 }
-}  // namespace
 
-ErrorCode GenerateCode(const std::vector<Module>& modules, std::string& code_out) {
-  code_out.clear();
-  std::vector<Function> functions = GetFunctionsFromModules(modules);
+void EmitFunctionDefinition(const AnalyzedFunction& analyzed, CodeEmitter& out) {
+  const Function& fn = *analyzed.fn;
+  out << GetFunctionDeclaration(fn, analyzed.reassigned_arguments) << "{\n";
+  for (const std::string& input_var : fn.GetVariablesList()) {
+    if (analyzed.reassigned_arguments.count(input_var) == 1) {
+      // Only copied if and when it's actually reassigned.
+      out << kPbStringType << input_var << kArgumentStorageSuffix << ";\n";
+      out << "const PBString* " << input_var << kLocalVarSuffix << " = &" << input_var
+          << kArgumentSuffix << ";\n";
+    }
+  }
+  if (analyzed.profile != nullptr) {
+    out << analyzed.profile->IncrementCode(analyzed.call_counter);
+  }
+  analyzed.body.EmitCode(out);
+  out << "\nreturn PBString();\n}\n\n\n";
+}
+
+// Everything known about a program once it's been checked.
+struct AnalyzedProgram {
+  std::vector<Function> functions;
+  int num_main_args = 0;
+  std::unique_ptr<Profile> feedback;
+  std::vector<FunctionProfile> profiles;
+  size_t num_counters = 0;
+  std::vector<AnalyzedFunction> analyzed_functions;
+  std::vector<std::string> sorted_globals;
+  std::string runtime_src;
+  // Evaluators point into it, so it's kept until code is emitted.
+  std::unique_ptr<BuiltinRegistry> builtins;
+};
+
+// Leaves program.functions empty if there is nothing to compile.
+ErrorCode AnalyzeProgram(const std::vector<Module>& modules, const CodegenOptions& options,
+                         AnalyzedProgram& program) {
+  program.functions = GetFunctionsFromModules(modules);
+  const std::vector<Function>& functions = program.functions;
   if (functions.empty()) {
     return ErrorCode::Success();
   }
   auto maybe_fns_dict = GetFunctionsDict(functions);
   RETURN_EC_IF_FAILURE(maybe_fns_dict);
   std::unordered_map<std::string, const Function*> functions_dict = std::move(maybe_fns_dict.GetItem());
-  std::unordered_set<std::string> global_variables;
 
-  const Function* main_fn = functions_dict["Main"];
-  if (main_fn == nullptr) {
+  const auto main_it = functions_dict.find("Main");
+  // Shared objects are called into by name instead.
+  if (options.shared_library) {
+    if (!options.profile_generate_file.empty()) {
+      return ErrorCode::Failure("Profiles are written when Main returns, so --profile-generate "
+                                "can't be used for a shared object.");
+    }
+  } else if (main_it == functions_dict.end()) {
     return ErrorCode::Failure("No Main fn defined");
+  } else {
+    const Function* main_fn = main_it->second;
+    program.num_main_args = main_fn->GetVariablesList().size();
+    if (program.num_main_args > 1) {
+      return ErrorCode::Failure("File: " + main_fn->GetFileName() + "; line: " + std::to_string(main_fn->GetLineNum()) +
+                                "; Main accepts too many args: " + std::to_string(program.num_main_args));
+    }
+  }
+
+  if (!options.profile_use_file.empty()) {
+    auto maybe_profile = Profile::Load(options.profile_use_file);
+    RETURN_EC_IF_FAILURE(maybe_profile);
+    program.feedback = std::make_unique<Profile>(std::move(maybe_profile.GetItem()));
+  }
+  if (options.builtins_file.empty()) {
+    program.builtins = std::make_unique<BuiltinRegistry>();
+  } else {
+    auto maybe_builtins = BuiltinRegistry::Load(options.builtins_file);
+    RETURN_EC_IF_FAILURE(maybe_builtins);
+    program.builtins = std::make_unique<BuiltinRegistry>(std::move(maybe_builtins.GetItem()));
   }
+  const bool instrument = !options.profile_generate_file.empty();
+  RETURN_EC_IF_FAILURE(GetPBStringSrc(options, program.runtime_src));
 
-  const int num_main_args = main_fn->GetVariablesList().size();
-  if (num_main_args > 1) {
-    return ErrorCode::Failure("File: " + main_fn->GetFileName() + "; line: " + std::to_string(main_fn->GetLineNum()) +
-                              "; Main accepts too many args: " + std::to_string(num_main_args));
+  std::vector<FunctionProfile>& profiles = program.profiles;
+  if (instrument || program.feedback != nullptr) {
+    profiles.reserve(functions.size());
+    for (const Function& fn : functions) {
+      profiles.emplace_back(fn.GetName(), instrument, program.feedback.get());
+    }
   }
 
-  code_out += "#define POIBOI_EXECUTABLE_\n#define POIBOI_INCLUDE_ASSERT_\n";
-  AddPBStringSrc(code_out);
+  // Functions are analyzed independently, each worker collecting the globals
+  // it finds.
+  const int num_threads = std::max(1, options.num_threads);
+  std::vector<std::unordered_set<std::string>> worker_global_variables(num_threads);
+  std::vector<ScopedSymbolTable> worker_symbols(num_threads);
+  std::vector<std::optional<ErrorOr<AnalyzedFunction>>> maybe_analyzed(functions.size());
+  ParallelFor(functions.size(), num_threads, [&](size_t i, int worker) {
+    CompilationContext context{.fns = &functions_dict,
+                               .all_global_variables = &worker_global_variables[worker],
+                               .builtins = program.builtins.get(),
+                               .symbols = &worker_symbols[worker],
+                               .globals_in_context = options.shared_library};
+    maybe_analyzed[i].emplace(AnalyzeFunction(
+        functions[i], context, profiles.empty() ? nullptr : &profiles[i]));
+  });
+  // Report the first failure in source order, whichever finished first.
+  program.analyzed_functions.reserve(functions.size());
+  for (auto& analyzed : maybe_analyzed) {
+    RETURN_EC_IF_FAILURE(*analyzed);
+    program.analyzed_functions.push_back(std::move(analyzed->GetItem()));
+  }
+  maybe_analyzed.clear();
+  std::unordered_set<std::string> global_variables;
+  for (const auto& worker_globals : worker_global_variables) {
+    global_variables.insert(worker_globals.begin(), worker_globals.end());
+  }
+  program.sorted_globals.assign(global_variables.begin(), global_variables.end());
+  std::sort(program.sorted_globals.begin(), program.sorted_globals.end());
+
+  for (FunctionProfile& profile : profiles) {
+    profile.set_counter_base(program.num_counters);
+    program.num_counters += profile.counter_keys().size();
+  }
+  return ErrorCode::Success();
+}
 
-  for (const Function& fn : functions) {
-    code_out += GetFunctionDeclaration(fn) + ";\n";
+void EmitDeclarations(const AnalyzedProgram& program, CodeEmitter& out) {
+  for (const std::string& header : program.builtins->headers()) {
+    out << "#include " << header << "\n";
   }
+  for (const Function& fn : program.functions) {
+    if (program.feedback != nullptr && fn.GetName() != "Main") {
+      out << GetFunctionAttributes(fn, *program.feedback);
+    }
+    out << GetFunctionDeclaration(fn) << ";\n";
+  }
+}
 
-  CompilationContext context{.fns = &functions_dict, .all_global_variables = &global_variables};
+// A shared object's globals, of which each context has its own copy. The
+// declarations include the struct, which every file accessing them needs.
+void EmitContextGlobals(const AnalyzedProgram& program, bool is_extern, CodeEmitter& out) {
+  if (!is_extern) {
+    out << "thread_local " << kGlobalsType << "* " << kGlobalsPointer << ";\n";
+    return;
+  }
+  out << "struct " << kGlobalsType << " {\n";
+  for (const std::string& global : program.sorted_globals) {
+    out << kPbStringType << global << kGlobalVarSuffix << ";\n";
+  }
+  out << "};\n";
+  out << "extern thread_local " << kGlobalsType << "* " << kGlobalsPointer << ";\n";
+}
 
-  std::vector<std::string> fn_definitions;
-  for (const Function& fn : functions) {
-    RETURN_EC_IF_FAILURE(GetFunctionDefinition(fn, context, fn_definitions.emplace_back()));
+// Definitions of the globals and profile counters, or only declarations if
+// is_extern.
+void EmitGlobals(const AnalyzedProgram& program, const CodegenOptions& options,
+                 bool is_extern, CodeEmitter& out) {
+  if (options.shared_library) {
+    EmitContextGlobals(program, is_extern, out);
+    return;
+  }
+  for (const std::string& global : program.sorted_globals) {
+    out << (is_extern ? "extern " : "") << kPbStringType << global << kGlobalVarSuffix << ";\n";
+  }
+  if (!options.profile_generate_file.empty()) {
+    out << (is_extern ? GetProfileCountersDeclarationCode(program.num_counters)
+                      : GetProfileCountersCode(program.num_counters));
   }
+}
 
-  std::vector<std::string> sorted_globals(global_variables.begin(), global_variables.end());
-  std::sort(sorted_globals.begin(), sorted_globals.end());
-  for (const std::string& global : sorted_globals) {
-    code_out += std::string(kPbStringType) + global + kGlobalVarSuffix +";\n";
+// Emits the definitions of functions [begin, end).
+void EmitDefinitions(const AnalyzedProgram& program, size_t begin, size_t end,
+                     int num_threads, CodeEmitter& out) {
+  if (num_threads == 1) {
+    for (size_t i = begin; i < end; ++i) {
+      EmitFunctionDefinition(program.analyzed_functions[i], out);
+      out << "\n\n\n";
+    }
+    return;
+  }
+  // Functions are emitted into their own buffers a batch at a time, then
+  // written out in order.
+  const size_t batch_size = kFunctionsPerThreadBatch * num_threads;
+  std::vector<std::string> definitions;
+  for (size_t start = begin; start < end; start += batch_size) {
+    const size_t batch_end = std::min(start + batch_size, end);
+    definitions.assign(batch_end - start, "");
+    ParallelFor(batch_end - start, num_threads, [&](size_t i, int worker) {
+      CodeEmitter definition_out(definitions[i]);
+      EmitFunctionDefinition(program.analyzed_functions[start + i], definition_out);
+    });
+    for (const std::string& definition : definitions) {
+      out << definition << "\n\n\n";
+    }
   }
+}
 
-  for (const std::string& fn_def : fn_definitions) {
-    code_out += fn_def + "\n\n\n";
+void EmitMain(const AnalyzedProgram& program, const CodegenOptions& options, CodeEmitter& out) {
+  std::string main_preamble;
+  if (!options.profile_generate_file.empty()) {
+    std::vector<const FunctionProfile*> profile_ptrs;
+    for (const FunctionProfile& profile : program.profiles) {
+      profile_ptrs.push_back(&profile);
+    }
+    out << GetProfileWriterCode(profile_ptrs, options.profile_generate_file) << "\n\n";
+    main_preamble = GetProfileWriterRegistrationCode();
   }
 
   const std::string main_cc_fn = std::string("Main") + kFnSuffix;
 
-  if (num_main_args == 0) {
-    code_out += "int main(int argc, char** argv) {\n";
-    code_out += main_cc_fn + "();\nreturn 0;\n}";
+  out << "int main(int argc, char** argv) {\n" << main_preamble;
+  if (program.num_main_args == 0) {
+    out << main_cc_fn << "();\nreturn 0;\n}";
   } else {
-    code_out += "int main(int argc, char** argv) {\n";
-    code_out += "if (argc == 1) {\n";
-    code_out += main_cc_fn + "(PBString());\n} else {\n";
-    code_out += main_cc_fn + "(PBString::NewStaticString(argv[1]));\n}";
-    code_out += "\nreturn 0;\n}";
+    out << "if (argc == 1) {\n";
+    out << main_cc_fn << "(PBString());\n} else {\n";
+    out << main_cc_fn << "(PBString::NewStaticString(argv[1]));\n}";
+    out << "\nreturn 0;\n}";
   }
+}
 
+// A shared object's table of entry points: a trampoline for each function,
+// taking the caller's globals and its arguments as an array, the table
+// listing them by name, and functions making and freeing globals.
+void EmitEntryTable(const AnalyzedProgram& program, CodeEmitter& out) {
+  std::vector<const Function*> sorted_functions;
+  for (const Function& fn : program.functions) {
+    const std::string fn_name = fn.GetName();
+    // Literals live in the shared object, which the result may outlive.
+    out << "static void " << fn_name << kEntrySuffix
+        << "(void* globals, const PBString* args, PBString* result) {\n"
+        << kGlobalsPointer << " = static_cast<" << kGlobalsType << "*>(globals);\n"
+        << "*result = PBString::OwnedCopy(" << fn_name << kFnSuffix << "(";
+    for (size_t i = 0; i < fn.GetVariablesList().size(); ++i) {
+      out << (i == 0 ? "" : ", ") << "args[" << std::to_string(i) << "]";
+    }
+    out << "));\n}\n\n";
+    sorted_functions.push_back(&fn);
+  }
+  std::sort(sorted_functions.begin(), sorted_functions.end(),
+            [](const Function* lhs, const Function* rhs) { return lhs->GetName() < rhs->GetName(); });
+  out << "static const PoiBoiFunctionEntry _poiboi_entries[] = {\n";
+  for (const Function* fn : sorted_functions) {
+    out << "{\"" << fn->GetName() << "\", " << std::to_string(fn->GetVariablesList().size())
+        << ", " << fn->GetName() << kEntrySuffix << "},\n";
+  }
+  out << "};\n\n";
+  out << "static void* _poiboi_new_globals() {\nreturn new " << kGlobalsType << "();\n}\n\n";
+  out << "static void _poiboi_delete_globals(void* globals) {\ndelete static_cast<"
+      << kGlobalsType << "*>(globals);\n}\n\n";
+  out << "extern \"C\" POIBOI_MODULE_EXPORT const PoiBoiModule* poiboi_module() {\n"
+      << "static const PoiBoiModule module = {POIBOI_MODULE_ABI_VERSION, sizeof(PBString), "
+      << std::to_string(sorted_functions.size()) << ", _poiboi_entries, "
+      << "_poiboi_new_globals, _poiboi_delete_globals};\n"
+      << "return &module;\n}\n";
+}
+
+// main() for an executable, or the entry table for a shared object.
+void EmitEntryPoints(const AnalyzedProgram& program, const CodegenOptions& options,
+                     CodeEmitter& out) {
+  if (options.shared_library) {
+    EmitEntryTable(program, out);
+  } else {
+    EmitMain(program, options, out);
+  }
+}
+
+// Splits the functions into the ranges each get their own file: one per
+// module, or functions_per_file at a time.
+std::vector<std::pair<size_t, size_t>> GetFileRanges(const std::vector<Function>& functions,
+                                                     size_t functions_per_file) {
+  std::vector<std::pair<size_t, size_t>> ranges;
+  size_t begin = 0;
+  for (size_t i = 1; i <= functions.size(); ++i) {
+    const bool new_file = i == functions.size() ||
+        (functions_per_file > 0 ? i - begin == functions_per_file
+                                : functions[i].GetFileName() != functions[begin].GetFileName());
+    if (new_file) {
+      ranges.emplace_back(begin, i);
+      begin = i;
+    }
+  }
+  return ranges;
+}
+
+// "dir/prog.cc" becomes "dir/prog".
+std::string StripExtension(const std::string& file_name) {
+  const size_t dot = file_name.rfind('.');
+  const size_t slash = file_name.rfind('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return file_name;
+  }
+  return file_name.substr(0, dot);
+}
+
+// "dir/prog.cc" is built into "dir/prog.so".
+std::string GetSharedLibraryName(const std::string& main_cc_file) {
+  return StripExtension(main_cc_file) + ".so";
+}
+
+// Release builds want -O3 and no C++ assertions either.
+std::string GetCompilerFlags(const CodegenOptions& options) {
+  std::string flags = "-std=c++20 -O" + std::to_string(options.optimization_level);
+  if (IsReleaseBuild(options)) {
+    flags += " -DNDEBUG";
+  }
+  if (options.lto) {
+    flags += " -flto";
+  }
+  if (options.shared_library) {
+    flags += " -shared -fPIC -fvisibility=hidden";
+  }
+  if (!options.embed_runtime) {
+    flags += " -I" + options.runtime_dir;
+  }
+  return flags;
+}
+
+// The runtime library is built in four flavors: with or without assertions,
+// and with or without -flto.
+std::string GetLinkFlags(const CodegenOptions& options) {
+  if (options.embed_runtime) {
+    return "";
+  }
+  std::string library = kRuntimeLibrary;
+  if (IsReleaseBuild(options)) {
+    library += kReleaseSuffix;
+  }
+  if (options.lto) {
+    library += kLtoSuffix;
+  }
+  std::string flags = "-L" + options.runtime_dir + " -l" + library;
+  // Keeps the runtime's symbols out of a shared object's exports, so only its
+  // entry table is visible.
+  if (options.shared_library) {
+    flags += " -Wl,--exclude-libs,ALL";
+  }
+  return flags;
+}
+
+}  // namespace
+
+ErrorCode GenerateCode(const std::vector<Module>& modules, const CodegenOptions& options,
+                       CodeEmitter& out) {
+  // Everything is checked before anything is written, so failures don't leave
+  // partial output behind.
+  AnalyzedProgram program;
+  RETURN_EC_IF_FAILURE(AnalyzeProgram(modules, options, program));
+  if (program.functions.empty()) {
+    return ErrorCode::Success();
+  }
+  out << program.runtime_src;
+  EmitDeclarations(program, out);
+  if (options.shared_library) {
+    EmitContextGlobals(program, /*is_extern=*/true, out);
+  }
+  EmitGlobals(program, options, /*is_extern=*/false, out);
+  EmitDefinitions(program, 0, program.functions.size(), std::max(1, options.num_threads), out);
+  EmitEntryPoints(program, options, out);
+  return ErrorCode::Success();
+}
+
+ErrorCode GenerateSplitCode(const std::vector<Module>& modules, const CodegenOptions& options,
+                            const std::string& output_file_name,
+                            std::vector<GeneratedFile>& files_out) {
+  files_out.clear();
+  if (options.embed_runtime) {
+    return ErrorCode::Failure("Split output links against the runtime library, so it can't "
+                              "be used with --embed-runtime.");
+  }
+  AnalyzedProgram program;
+  RETURN_EC_IF_FAILURE(AnalyzeProgram(modules, options, program));
+  if (program.functions.empty()) {
+    return ErrorCode::Success();
+  }
+  const std::string stem = StripExtension(output_file_name);
+  const std::string header_name = stem + ".h";
+  const size_t slash = header_name.rfind('/');
+  const std::string include = "#include \"" +
+      (slash == std::string::npos ? header_name : header_name.substr(slash + 1)) + "\"\n";
+  const std::vector<std::pair<size_t, size_t>> ranges =
+      GetFileRanges(program.functions, options.functions_per_file);
+
+  files_out.resize(ranges.size() + 2);
+  files_out[0].file_name = header_name;
+  {
+    CodeEmitter out(files_out[0].code);
+    out << "#pragma once\n" << program.runtime_src;
+    EmitDeclarations(program, out);
+    EmitGlobals(program, options, /*is_extern=*/true, out);
+  }
+  files_out[1].file_name = output_file_name;
+  {
+    CodeEmitter out(files_out[1].code);
+    out << include;
+    EmitGlobals(program, options, /*is_extern=*/false, out);
+    EmitEntryPoints(program, options, out);
+  }
+  ParallelFor(ranges.size(), std::max(1, options.num_threads), [&](size_t i, int worker) {
+    GeneratedFile& file = files_out[i + 2];
+    file.file_name = stem + "_" + std::to_string(i) + ".cc";
+    CodeEmitter out(file.code);
+    out << include;
+    EmitDefinitions(program, ranges[i].first, ranges[i].second, /*num_threads=*/1, out);
+  });
+  return ErrorCode::Success();
+}
+
+ErrorCode GenerateBytecode(const std::vector<Module>& modules, const CodegenOptions& options,
+                           BytecodeProgram& program_out) {
+  // Native builtins are C++ functions, which the VM can't call.
+  CodegenOptions core_options = options;
+  core_options.builtins_file.clear();
+  AnalyzedProgram program;
+  RETURN_EC_IF_FAILURE(AnalyzeProgram(modules, core_options, program));
+  if (program.functions.empty()) {
+    return ErrorCode::Failure("No Main fn defined");
+  }
+  std::vector<std::string> function_names;
+  for (const Function& fn : program.functions) {
+    function_names.push_back(fn.GetName());
+  }
+  BytecodeBuilder builder(function_names, program.sorted_globals);
+  for (const AnalyzedFunction& analyzed : program.analyzed_functions) {
+    const Function& fn = *analyzed.fn;
+    // Sorted, so registers don't depend on hash order.
+    std::vector<std::string> locals;
+    for (const auto& [name, unused] : CollectVariableAssignments(fn.GetCode()).assignments) {
+      locals.push_back(name);
+    }
+    std::sort(locals.begin(), locals.end());
+    builder.StartFunction(fn.GetName(), fn.GetVariablesList(), locals);
+    analyzed.body.EmitBytecode(builder);
+    builder.FinishFunction();
+  }
+  program_out = builder.TakeProgram();
   return ErrorCode::Success();
 }
 
+std::string GetBuildCommand(const CodegenOptions& options,
+                            const std::vector<std::string>& cc_files) {
+  std::string command = "g++ " + GetCompilerFlags(options);
+  for (const std::string& cc_file : cc_files) {
+    command += " " + cc_file;
+  }
+  if (options.shared_library && !cc_files.empty()) {
+    command += " -o " + GetSharedLibraryName(cc_files.front());
+  }
+  const std::string link_flags = GetLinkFlags(options);
+  if (!link_flags.empty()) {
+    command += " " + link_flags;
+  }
+  return command;
+}
+
+GeneratedFile GetBuildManifest(const CodegenOptions& options,
+                               const std::string& output_file_name,
+                               const std::vector<std::string>& cc_files) {
+  GeneratedFile manifest{.file_name = StripExtension(output_file_name) + ".build"};
+  manifest.code = "# Generated by poiboic. How to build this program.\n";
+  manifest.code += "compiler: g++\n";
+  manifest.code += "cxxflags: " + GetCompilerFlags(options) + "\n";
+  manifest.code += "sources:";
+  for (const std::string& cc_file : cc_files) {
+    manifest.code += " " + cc_file;
+  }
+  manifest.code += "\nldflags: " + GetLinkFlags(options) + "\n";
+  manifest.code += "command: " + GetBuildCommand(options, cc_files) + "\n";
+  return manifest;
+}
+
 }  // namespace pbc
@@ -17,12 +17,79 @@ limitations under the License.
 #ifndef POIBOIC_CODEGEN_H_
 #define POIBOIC_CODEGEN_H_
 
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "code_emitter.h"
 #include "error_code.h"
 #include "grammar.h"
 
 namespace pbc {
 
-ErrorCode GenerateCode(const std::vector<Module>& modules, std::string& code_out);
+struct CodegenOptions {
+  // Directory with the runtime header, its source and the runtime libraries.
+  std::string runtime_dir;
+  // Paste the runtime source into the output instead of including its header,
+  // so the output builds without the runtime library.
+  bool embed_runtime = false;
+  // Link against the runtime library built with -flto, letting GCC inline
+  // runtime functions into the program.
+  bool lto = false;
+  // The -O level the output is meant to be built with. At 3 and above, the
+  // program is a release build: the runtime's assertions are dropped and its
+  // smallest helpers are forced inline.
+  int optimization_level = 2;
+  // Build a shared object exporting a table of every function, as described
+  // in poiboi_module.h, instead of an executable. Main is optional.
+  bool shared_library = false;
+  // How many threads to analyze and emit functions on.
+  int num_threads = 1;
+  // Whether to write several files with GenerateSplitCode, rather than one.
+  bool split_output = false;
+  // When splitting, how many functions go in each file. If 0, each module
+  // gets its own file.
+  size_t functions_per_file = 0;
+  // If set, the program counts calls, branches and loop trips and writes them
+  // to this file on exit.
+  std::string profile_generate_file;
+  // If set, a profile written by a --profile-generate build to optimize with.
+  std::string profile_use_file;
+  // If set, a file of native builtins to add, as described in builtins.h.
+  std::string builtins_file;
+};
+
+// Nothing is written to out on failure.
+ErrorCode GenerateCode(const std::vector<Module>& modules, const CodegenOptions& options,
+                       CodeEmitter& out);
+
+struct GeneratedFile {
+  std::string file_name;
+  std::string code;
+};
+
+// Generates the program across several files so they can be compiled in
+// parallel. Given output_file_name "prog.cc", writes prog.h declaring every
+// function and global, prog.cc defining the globals and main, and prog_0.cc,
+// prog_1.cc, ... defining the functions. Requires the runtime library.
+ErrorCode GenerateSplitCode(const std::vector<Module>& modules, const CodegenOptions& options,
+                            const std::string& output_file_name,
+                            std::vector<GeneratedFile>& files_out);
+
+// Lowers the program to bytecode for the VM instead of generating C++. Only
+// num_threads matters out of options; the VM has just the core builtins.
+ErrorCode GenerateBytecode(const std::vector<Module>& modules, const CodegenOptions& options,
+                           BytecodeProgram& program_out);
+
+// The command to build an executable from generated cc_files.
+std::string GetBuildCommand(const CodegenOptions& options,
+                            const std::vector<std::string>& cc_files);
+
+// A manifest recording the compiler flags, sources and libraries to build
+// the program with. Given output_file_name "prog.cc", it's named prog.build.
+GeneratedFile GetBuildManifest(const CodegenOptions& options,
+                               const std::string& output_file_name,
+                               const std::vector<std::string>& cc_files);
 
 }  // namespace pbc
 
@@ -16,10 +16,16 @@ limitations under the License.
 
 #include "evaluator.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <optional>
+#include <unordered_set>
 #include <variant>
 
 #include "code_suffices.h"
 #include "tokens.h"
+#include "variable_analysis.h"
 
 namespace pbc {
 
@@ -28,6 +34,12 @@ class FunctionCallEvaluator;
 
 struct VariableAccessor {
   bool is_local{};
+  // Local variable stored as a size_t instead of a PBString.
+  bool is_size{};
+  // Reassigned argument, held as a pointer to a PBString.
+  bool is_argument_pointer{};
+  // Global held by the calling context rather than as a C++ global.
+  bool is_in_context{};
   std::string name;
 };
 
@@ -35,225 +47,340 @@ std::string LocalVariableName(const std::string& name) {
   return name + kLocalVarSuffix;
 }
 
-std::string GlobalVariableName(const std::string& name) {
-  return name + kGlobalVarSuffix;
+bool IsInSet(const std::unordered_set<std::string>* set, const std::string& name) {
+  return set != nullptr && set->count(name) == 1;
+}
+
+std::string GlobalVariableName(const std::string& name, bool is_in_context) {
+  return (is_in_context ? std::string(kGlobalsPointer) + "->" : "") + name + kGlobalVarSuffix;
 }
 
 class RValueEvaluator {
  public:
   static ErrorOr<RValueEvaluator> TryCreate(const RValue& rv, CompilationContext& context);
-  std::string GetCode() const;
+  void EmitCode(CodeEmitter& out) const;
+  // Code for passing this to a PoiBoi function, which takes its arguments by
+  // reference. Globals are copied, as the callee could reassign them.
+  void EmitArgumentCode(CodeEmitter& out) const;
+  // Whether this always evaluates to a canonical non-negative integer, in
+  // which case EmitSizeCode() gives it as a size_t expression.
+  bool IsSize() const;
+  void EmitSizeCode(CodeEmitter& out) const;
+  // Whether the index SUBSTRING would read from this is available without
+  // building and parsing a PBString.
+  bool HasDirectSubstringIndex() const;
+  // Code for the size_t that SUBSTRING interprets this as, for the start
+  // index if is_start, otherwise the end index.
+  void EmitSubstringIndexCode(CodeEmitter& out, bool is_start) const;
+  // Evaluates this into register dst.
+  void EmitBytecode(BytecodeBuilder& out, uint32_t dst) const;
+  // Returns a register holding the value: a local variable's own, or a new
+  // temporary.
+  uint32_t EmitBytecodeOperand(BytecodeBuilder& out) const;
+  // Whether evaluating this has no side effects.
+  bool IsPure() const;
  private:
-  RValueEvaluator(std::variant<QuotedString, VariableAccessor, std::unique_ptr<FunctionCallEvaluator>> op)
+  // The string literal this is, if it is one.
+  const QuotedString* GetQuotedString() const {
+    const QuotedString* const* quoted_string = std::get_if<const QuotedString*>(&op_);
+    return quoted_string != nullptr ? *quoted_string : nullptr;
+  }
+  RValueEvaluator(std::variant<const QuotedString*, VariableAccessor, std::unique_ptr<FunctionCallEvaluator>> op)
       : op_(std::move(op)) {}
-  std::variant<QuotedString, VariableAccessor, std::unique_ptr<FunctionCallEvaluator>> op_;
+  std::variant<const QuotedString*, VariableAccessor, std::unique_ptr<FunctionCallEvaluator>> op_;
 };
 
 class VariableAssignmentEvaluator : public StatementEvaluator {
  public:
   static ErrorOr<VariableAssignmentEvaluator> TryCreate(const VariableAssignment& va, CompilationContext& context);
-  std::string GetCode() const override;
+  void EmitCode(CodeEmitter& out) const override;
+  void EmitBytecode(BytecodeBuilder& out) const override;
  private:
-  VariableAssignmentEvaluator(bool local, bool already_defined, std::string name, RValueEvaluator e)
-    : is_local_(local), already_defined_(already_defined), name_(std::move(name)), e_(std::move(e)) {}
+  VariableAssignmentEvaluator(bool local, bool already_defined, bool is_size, bool is_argument_pointer,
+                              bool is_in_context, std::string name, RValueEvaluator e)
+    : is_local_(local), already_defined_(already_defined), is_size_(is_size),
+      is_argument_pointer_(is_argument_pointer), is_in_context_(is_in_context),
+      name_(std::move(name)), e_(std::move(e)) {}
   bool is_local_{};
   bool already_defined_{};
+  bool is_size_{};
+  bool is_argument_pointer_{};
+  bool is_in_context_{};
   std::string name_;
   RValueEvaluator e_;
 };
 
 ErrorOr<VariableAssignmentEvaluator> VariableAssignmentEvaluator::TryCreate(
     const VariableAssignment& va, CompilationContext& context) {
-  const auto& children = va.GetChildren();
-  assert(children.size() == 3);
-  assert(children.back()->GetLabel() == GrammarLabel::RVALUE);
-  const RValue& rval = dynamic_cast<const RValue&>(*children.back());
-  assert(children.front()->GetLabel() == GrammarLabel::VARIABLE);
-  const Variable& var = dynamic_cast<const Variable&>(*children.front());
+  const RValue& rval = GetChild<RValue, 2>(va);
+  const Variable& var = GetChild<Variable, 0>(va);
   const std::string& var_name = var.GetContent();
-  const bool is_predefined_local = context.curr_local_variables.count(var_name) == 1;
-  const bool is_predefined_global = context.curr_global_variables.count(var_name) == 1;
+  const Binding binding = context.symbols->Lookup(var.symbol());
+  const bool is_predefined_local = binding == Binding::LOCAL;
+  const bool is_predefined_global = binding == Binding::GLOBAL;
   auto rvalue_eval = RValueEvaluator::TryCreate(rval, context);
   RETURN_EC_IF_FAILURE(rvalue_eval);
 
   if (is_predefined_global) {
     assert(!is_predefined_local);
-    return VariableAssignmentEvaluator(/*local=*/false, /*already_defined=*/true, var_name, std::move(rvalue_eval.GetItem()));
-  } else if (is_predefined_local) {
-    return VariableAssignmentEvaluator(/*local=*/true, /*already_defined=*/true, var_name, std::move(rvalue_eval.GetItem()));
+    return VariableAssignmentEvaluator(/*local=*/false, /*already_defined=*/true, /*is_size=*/false,
+                                       /*is_argument_pointer=*/false, context.globals_in_context,
+                                       var_name, std::move(rvalue_eval.GetItem()));
   }
-  context.curr_local_variables.insert(var_name);
-  return VariableAssignmentEvaluator(/*local=*/true, /*already_defined=*/false, var_name, std::move(rvalue_eval.GetItem()));
+  const bool is_size = IsInSet(context.size_variables, var_name);
+  // Size variables are only inferred if every assignment to them is size shaped.
+  assert(!is_size || rvalue_eval.GetItem().IsSize());
+  if (is_predefined_local) {
+    const bool is_argument_pointer = IsInSet(context.reassigned_arguments, var_name);
+    return VariableAssignmentEvaluator(/*local=*/true, /*already_defined=*/true, is_size,
+                                       is_argument_pointer, /*is_in_context=*/false, var_name,
+                                       std::move(rvalue_eval.GetItem()));
+  }
+  context.symbols->Bind(var.symbol(), Binding::LOCAL);
+  return VariableAssignmentEvaluator(/*local=*/true, /*already_defined=*/false, is_size,
+                                     /*is_argument_pointer=*/false, /*is_in_context=*/false,
+                                     var_name, std::move(rvalue_eval.GetItem()));
 }
 
-std::string VariableAssignmentEvaluator::GetCode() const {
-  std::string code;
+void VariableAssignmentEvaluator::EmitCode(CodeEmitter& out) const {
+  if (is_argument_pointer_) {
+    // First write copies into the storage and repoints; later ones reuse it.
+    out << LocalVariableName(name_) << " = &(" << name_ << kArgumentStorageSuffix << " = ";
+    e_.EmitCode(out);
+    out << ");\n";
+    return;
+  }
   if (is_local_ && !already_defined_) {
-    code += kPbStringType;
+    out << (is_size_ ? kSizeType : kPbStringType);
+  }
+  if (is_local_) {
+    out << LocalVariableName(name_);
+  } else {
+    out << GlobalVariableName(name_, is_in_context_);
+  }
+  out << " = ";
+  if (is_size_) {
+    e_.EmitSizeCode(out);
+  } else {
+    e_.EmitCode(out);
   }
+  out << ";\n";
+}
+
+void VariableAssignmentEvaluator::EmitBytecode(BytecodeBuilder& out) const {
   if (is_local_) {
-    code += LocalVariableName(name_);
+    e_.EmitBytecode(out, out.LocalRegister(name_));
   } else {
-    code += GlobalVariableName(name_);
+    const uint32_t value = e_.EmitBytecodeOperand(out);
+    out.Emit(Opcode::STORE_GLOBAL, out.GlobalId(name_), value);
   }
-  code += " = " + e_.GetCode() + ";\n";
-  return code;
 }
 
 class GlobalDeclarationEvaluator : public StatementEvaluator {
  public:
   static ErrorOr<GlobalDeclarationEvaluator> TryCreate(const GlobalDeclaration& va, CompilationContext& context);
   // No code generated for this; only affects the CompilationContext.
-  std::string GetCode() const override { return ""; }
+  void EmitCode(CodeEmitter& out) const override {}
+  void EmitBytecode(BytecodeBuilder& out) const override {}
  private:
   GlobalDeclarationEvaluator(std::string name) : name_(std::move(name)) {}
   std::string name_;
 };
 
 ErrorOr<GlobalDeclarationEvaluator> GlobalDeclarationEvaluator::TryCreate(const GlobalDeclaration& gd, CompilationContext& context) {
-  const auto& children = gd.GetChildren();
-  assert(children.size() == 2);
-  const auto& child1 = *children[1];
-  assert(child1.GetLabel() == GrammarLabel::VARIABLE);
-  const Variable& var = dynamic_cast<const Variable&>(child1);
+  const Variable& var = GetChild<Variable, 1>(gd);
   const std::string& var_name = var.GetContent();
-  if (context.curr_local_variables.count(var_name) == 1) {
+  if (context.symbols->Lookup(var.symbol()) == Binding::LOCAL) {
     return ErrorCode::Failure("File: " + var.file_name() + "; line: " +
                               std::to_string(var.line_number()) +
                               "; Cannot declare predefined local variable : " +
                               var_name + " as global.");
 
   }
-  context.curr_global_variables.insert(var_name);
+  context.symbols->Bind(var.symbol(), Binding::GLOBAL);
   context.all_global_variables->insert(var_name);
   return GlobalDeclarationEvaluator(var_name);
 }
 
-enum class BuiltinType {
-  EQUAL,
-  PRINT,
-  CONCAT,
-  NOT,
-  AND,
-  OR,
-  STRLEN,
-  SUBSTRING,
-};
-
-class BuiltinResolver {
- public:
-  static ErrorOr<BuiltinResolver> TryCreate(
-      const std::string& name, size_t line_num, const std::string& fname);
-  const std::string& GetCppName() const { return cpp_name_; }
-  int GetNumArgs() const { return num_args_; }
-
- private:
-  BuiltinResolver(BuiltinType type, std::string cpp_name, int num_args)
-      : /*type_(type),*/ cpp_name_(std::move(cpp_name)), num_args_(num_args) {}
-  // BuiltinType type_;
-  std::string cpp_name_;
-  int num_args_{};
-};
-
-ErrorOr<BuiltinResolver> BuiltinResolver::TryCreate(
-    const std::string& name, size_t line_num, const std::string& fname) {
-  if (name == "EQUAL") {
-    return BuiltinResolver(BuiltinType::EQUAL, "Builtin_Equal", 2);
-  } else if (name == "PRINT") {
-    return BuiltinResolver(BuiltinType::PRINT, "Builtin_Print", 1);
-  } else if (name == "CONCAT") {
-    return BuiltinResolver(BuiltinType::CONCAT, "Builtin_Concat", 2);
-  } else if (name == "NOT") {
-    return BuiltinResolver(BuiltinType::NOT, "Builtin_Not", 1);
-  } else if (name == "AND") {
-    return BuiltinResolver(BuiltinType::AND, "Builtin_And", 2);
-  } else if (name == "OR") {
-    return BuiltinResolver(BuiltinType::OR, "Builtin_Or", 2);
-  } else if (name == "STRLEN") {
-    return BuiltinResolver(BuiltinType::STRLEN, "Builtin_Strlen", 1);
-  } else if (name == "SUBSTRING") {
-    return BuiltinResolver(BuiltinType::SUBSTRING, "Builtin_Substring", 3);
-  }
-  return ErrorCode::Failure("File: " + fname + "; line: " + std::to_string(line_num) +
-                            "; Invalid builtin fn: " + name);
-}
-
 class FunctionCallEvaluator : public StatementEvaluator {
    public:
     static ErrorOr<FunctionCallEvaluator> TryCreate(const FunctionCall& fc, CompilationContext& context);
-    std::string GetCode() const override;
+    void EmitCode(CodeEmitter& out) const override;
+    bool IsExpression() const override { return true; }
+    bool IsSize() const;
+    void EmitSizeCode(CodeEmitter& out) const;
+    // As a statement, the result goes to a temporary nobody reads.
+    void EmitBytecode(BytecodeBuilder& out) const override;
+    void EmitBytecode(BytecodeBuilder& out, uint32_t dst) const;
+    // Whether the call has no side effects: a pure builtin of pure arguments.
+    bool IsPure() const;
    private:
-    FunctionCallEvaluator(std::variant<std::string, BuiltinResolver> fnob, std::vector<RValueEvaluator> a) :
+    bool IsBuiltin(BuiltinType type) const;
+    FunctionCallEvaluator(std::variant<std::string, const NativeBuiltin*> fnob, std::vector<RValueEvaluator> a) :
       fn_name_or_builtin_(std::move(fnob)), args_(std::move(a)) {}
-    std::variant<std::string, BuiltinResolver> fn_name_or_builtin_;
+    std::variant<std::string, const NativeBuiltin*> fn_name_or_builtin_;
     std::vector<RValueEvaluator> args_;
 };
 
 ErrorOr<RValueEvaluator> RValueEvaluator::TryCreate(
     const RValue& rv, CompilationContext& context) {
-  const auto& children = rv.GetChildren();
-  assert(children.size() == 1);
-  const auto& child = *children[0];
-  std::variant<QuotedString, VariableAccessor, std::unique_ptr<FunctionCallEvaluator>> op;
-  if (child.GetLabel() == GrammarLabel::FUNCTION_CALL) {
-    const FunctionCall& fc = dynamic_cast<const FunctionCall&>(child);
-    auto fce = FunctionCallEvaluator::TryCreate(fc, context);
-    RETURN_EC_IF_FAILURE(fce);
-    op = std::make_unique<FunctionCallEvaluator>(std::move(fce.GetItem()));
-  } else if (child.GetLabel() == GrammarLabel::QUOTED_STRING) {
-    op = dynamic_cast<const QuotedString&>(child);
-  } else {
-    assert(child.GetLabel() == GrammarLabel::VARIABLE);
-    const Variable& var = dynamic_cast<const Variable&>(child);
-    const std::string& var_name = var.GetContent();
-    if (context.curr_local_variables.count(var_name) == 1) {
-      op = VariableAccessor{.is_local = true, .name = var_name};
-    } else if (context.curr_global_variables.count(var_name) == 1) {
-      op = VariableAccessor{.is_local = false, .name = var_name};
-    } else {
-      return ErrorCode::Failure("File: " + child.file_name() + "; line: " +
-                                std::to_string(child.line_number()) +
-                                "; Undefined variable: " + var_name);
-    }
-  }
-  return RValueEvaluator(std::move(op));
+  return VisitChild<0, FunctionCall, QuotedString, Variable>(rv, Visitor{
+      [&](const FunctionCall& fc) -> ErrorOr<RValueEvaluator> {
+        auto fce = FunctionCallEvaluator::TryCreate(fc, context);
+        RETURN_EC_IF_FAILURE(fce);
+        return RValueEvaluator(std::make_unique<FunctionCallEvaluator>(std::move(fce.GetItem())));
+      },
+      [&](const QuotedString& quoted_string) -> ErrorOr<RValueEvaluator> {
+        return RValueEvaluator(&quoted_string);
+      },
+      [&](const Variable& var) -> ErrorOr<RValueEvaluator> {
+        const std::string& var_name = var.GetContent();
+        const Binding binding = context.symbols->Lookup(var.symbol());
+        if (binding == Binding::LOCAL) {
+          return RValueEvaluator(VariableAccessor{
+              .is_local = true,
+              .is_size = IsInSet(context.size_variables, var_name),
+              .is_argument_pointer = IsInSet(context.reassigned_arguments, var_name),
+              .name = var_name});
+        } else if (binding == Binding::GLOBAL) {
+          return RValueEvaluator(VariableAccessor{
+              .is_local = false, .is_in_context = context.globals_in_context, .name = var_name});
+        }
+        return ErrorCode::Failure("File: " + var.file_name() + "; line: " +
+                                  std::to_string(var.line_number()) +
+                                  "; Undefined variable: " + var_name);
+      }});
 }
 
-std::string RValueEvaluator::GetCode() const {
-  const QuotedString* quoted_string = std::get_if<QuotedString>(&op_);
+void RValueEvaluator::EmitCode(CodeEmitter& out) const {
+  const QuotedString* quoted_string = GetQuotedString();
   const VariableAccessor* variable = std::get_if<VariableAccessor>(&op_);
   const std::unique_ptr<FunctionCallEvaluator>* fn_call = std::get_if<std::unique_ptr<FunctionCallEvaluator>>(&op_);
   if (quoted_string != nullptr) {
-    return std::string("PBString::NewStaticString(") + quoted_string->GetContent() + ")";
+    out << "PBString::NewStaticString(" << quoted_string->GetContent() << ")";
   } else if (variable != nullptr) {
-    return variable->is_local ? LocalVariableName(variable->name) : GlobalVariableName(variable->name);
+    if (variable->is_size) {
+      // The size escapes into a string context.
+      out << "PBString::SizeToString(" << LocalVariableName(variable->name) << ")";
+    } else if (variable->is_argument_pointer) {
+      out << "(*" << LocalVariableName(variable->name) << ")";
+    } else {
+      out << (variable->is_local ? LocalVariableName(variable->name)
+                                 : GlobalVariableName(variable->name, variable->is_in_context));
+    }
+  } else {
+    assert(fn_call != nullptr);
+    (**fn_call).EmitCode(out);
+  }
+}
+
+void RValueEvaluator::EmitArgumentCode(CodeEmitter& out) const {
+  const VariableAccessor* variable = std::get_if<VariableAccessor>(&op_);
+  if (variable != nullptr && !variable->is_local) {
+    out << "PBString(" << GlobalVariableName(variable->name, variable->is_in_context) << ")";
+    return;
+  }
+  EmitCode(out);
+}
+
+bool RValueEvaluator::IsSize() const {
+  if (const QuotedString* quoted_string = GetQuotedString()) {
+    size_t unused;
+    return IsCanonicalSizeLiteral(*quoted_string, unused);
+  } else if (const VariableAccessor* variable = std::get_if<VariableAccessor>(&op_)) {
+    return variable->is_size;
+  }
+  return std::get<std::unique_ptr<FunctionCallEvaluator>>(op_)->IsSize();
+}
+
+void RValueEvaluator::EmitSizeCode(CodeEmitter& out) const {
+  assert(IsSize());
+  if (const QuotedString* quoted_string = GetQuotedString()) {
+    size_t value;
+    IsCanonicalSizeLiteral(*quoted_string, value);
+    out << "size_t{" << std::to_string(value) << "u}";
+  } else if (const VariableAccessor* variable = std::get_if<VariableAccessor>(&op_)) {
+    out << LocalVariableName(variable->name);
+  } else {
+    std::get<std::unique_ptr<FunctionCallEvaluator>>(op_)->EmitSizeCode(out);
+  }
+}
+
+bool RValueEvaluator::HasDirectSubstringIndex() const {
+  if (IsSize()) {
+    return true;
+  }
+  const QuotedString* quoted_string = GetQuotedString();
+  std::optional<size_t> unused;
+  return quoted_string != nullptr &&
+         ResolveSubstringIndexLiteral(*quoted_string, unused);
+}
+
+void RValueEvaluator::EmitSubstringIndexCode(CodeEmitter& out, bool is_start) const {
+  if (IsSize()) {
+    EmitSizeCode(out);
+    return;
+  }
+  const QuotedString* quoted_string = GetQuotedString();
+  std::optional<size_t> index;
+  if (quoted_string != nullptr &&
+      ResolveSubstringIndexLiteral(*quoted_string, index)) {
+    if (index.has_value()) {
+      out << "size_t{" << std::to_string(*index) << "u}";
+    } else {
+      // Builtin_SubstringStartIndex/EndIndex defaults.
+      out << (is_start ? "size_t{0u}" : "std::numeric_limits<size_t>::max()");
+    }
+    return;
+  }
+  out << (is_start ? "Builtin_SubstringStartIndex(" : "Builtin_SubstringEndIndex(");
+  EmitCode(out);
+  out << ")";
+}
+
+void RValueEvaluator::EmitBytecode(BytecodeBuilder& out, uint32_t dst) const {
+  if (const QuotedString* quoted_string = GetQuotedString()) {
+    out.Emit(Opcode::LOAD_CONSTANT, dst, out.ConstantId(quoted_string->GetContent()));
+  } else if (const VariableAccessor* variable = std::get_if<VariableAccessor>(&op_)) {
+    // Size variables hold strings in the VM, like every other variable.
+    if (variable->is_local) {
+      const uint32_t src = out.LocalRegister(variable->name);
+      if (src != dst) {
+        out.Emit(Opcode::MOVE, dst, src);
+      }
+    } else {
+      out.Emit(Opcode::LOAD_GLOBAL, dst, out.GlobalId(variable->name));
+    }
+  } else {
+    std::get<std::unique_ptr<FunctionCallEvaluator>>(op_)->EmitBytecode(out, dst);
   }
-  assert(fn_call != nullptr);
-  return (**fn_call).GetCode();
+}
 
+bool RValueEvaluator::IsPure() const {
+  const std::unique_ptr<FunctionCallEvaluator>* fn_call =
+      std::get_if<std::unique_ptr<FunctionCallEvaluator>>(&op_);
+  return fn_call == nullptr || (**fn_call).IsPure();
+}
+
+uint32_t RValueEvaluator::EmitBytecodeOperand(BytecodeBuilder& out) const {
+  const VariableAccessor* variable = std::get_if<VariableAccessor>(&op_);
+  if (variable != nullptr && variable->is_local) {
+    return out.LocalRegister(variable->name);
+  }
+  // Globals are copied, since a call later in the same expression could
+  // reassign them.
+  const uint32_t dst = out.NewTemporary();
+  EmitBytecode(out, dst);
+  return dst;
 }
 
 namespace {
 
 std::vector<const RValue*> ExpandRValueList(const RValueList& rvl) {
   std::vector<const RValue*> rv_vec;
-  const auto& rvl_children = rvl.GetChildren();
-  if (rvl_children.size() == 0) {
-    return rv_vec;
-  }
-  assert(rvl_children.size() == 2);
-  assert(rvl_children[0]->GetLabel() == GrammarLabel::RVALUE);
-  rv_vec.push_back(dynamic_cast<const RValue*>(&*rvl_children[0]));
-
-  assert(rvl_children[1]->GetLabel() == GrammarLabel::RVALUE_LIST_EXPANSION);
-  const RValueListExpansion* curr_expansion = dynamic_cast<const RValueListExpansion*>(&*rvl_children[1]);
-  while (!curr_expansion->GetChildren().empty()) {
-    const auto& expansion_children = curr_expansion->GetChildren();
-    assert(expansion_children.size() == 3);
-    assert(expansion_children[1]->GetLabel() == GrammarLabel::RVALUE);
-    rv_vec.push_back(dynamic_cast<const RValue*>(&*expansion_children[1]));
-    assert(expansion_children[2]->GetLabel() == GrammarLabel::RVALUE_LIST_EXPANSION);
-    curr_expansion = dynamic_cast<const RValueListExpansion*>(&*expansion_children[2]);
+  rv_vec.reserve(rvl.GetChildren().size());
+  for (const GrammarPiece* rvalue : rvl.GetChildren()) {
+    rv_vec.push_back(&PieceCast<RValue>(*rvalue));
   }
   return rv_vec;
 }
@@ -268,14 +395,17 @@ ErrorOr<FunctionCallEvaluator> FunctionCallEvaluator::TryCreate(
   const auto& child0 = *fc_children[0];
   int num_args = 0;
   std::string debug_fn_name;
-  std::variant<std::string, BuiltinResolver> fn_name_or_builtin{""};
+  std::variant<std::string, const NativeBuiltin*> fn_name_or_builtin{""};
   if (child0.GetLabel() == GrammarLabel::BUILTIN) {
     debug_fn_name = std::string("builtin ") + child0.GetContent();
-    auto builtin = BuiltinResolver::TryCreate(
-        child0.GetContent(), child0.line_number(), child0.file_name());
-    RETURN_EC_IF_FAILURE(builtin);
-    fn_name_or_builtin = std::move(builtin.GetItem());
-    num_args = builtin.GetItem().GetNumArgs();
+    const NativeBuiltin* builtin = context.builtins->Find(child0.GetContent());
+    if (builtin == nullptr) {
+      return ErrorCode::Failure("File: " + child0.file_name() + "; line: " +
+                                std::to_string(child0.line_number()) +
+                                "; Invalid builtin fn: " + child0.GetContent());
+    }
+    fn_name_or_builtin = builtin;
+    num_args = builtin->num_args;
   } else {
     assert(child0.GetLabel() == GrammarLabel::FUNCTION_NAME);
     const std::string fn_name = child0.GetContent();
@@ -290,10 +420,7 @@ ErrorOr<FunctionCallEvaluator> FunctionCallEvaluator::TryCreate(
     fn_name_or_builtin = fn_name;
     num_args = fn_it->second->GetVariablesList().size();
   }
-  const auto& child2 = *fc_children[2];
-  assert(child2.GetLabel() == GrammarLabel::RVALUE_LIST);
-
-  std::vector<const RValue*> rvalue_args = ExpandRValueList(dynamic_cast<const RValueList&>(child2));
+  std::vector<const RValue*> rvalue_args = ExpandRValueList(GetChild<RValueList, 2>(fc));
   if (rvalue_args.size() != num_args) {
     return ErrorCode::Failure("File: " + child0.file_name() + "; line: " +
                               std::to_string(child0.line_number()) +
@@ -311,136 +438,414 @@ ErrorOr<FunctionCallEvaluator> FunctionCallEvaluator::TryCreate(
   return FunctionCallEvaluator(std::move(fn_name_or_builtin), std::move(args));
 }
 
-std::string FunctionCallEvaluator::GetCode() const {
-  std::string code;
+bool FunctionCallEvaluator::IsBuiltin(BuiltinType type) const {
+  const NativeBuiltin* const* builtin = std::get_if<const NativeBuiltin*>(&fn_name_or_builtin_);
+  return builtin != nullptr && (*builtin)->type == type;
+}
+
+bool FunctionCallEvaluator::IsPure() const {
+  const NativeBuiltin* const* builtin = std::get_if<const NativeBuiltin*>(&fn_name_or_builtin_);
+  if (builtin == nullptr || !(*builtin)->is_pure) {
+    return false;
+  }
+  for (const RValueEvaluator& arg : args_) {
+    if (!arg.IsPure()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FunctionCallEvaluator::IsSize() const {
+  return IsBuiltin(BuiltinType::STRLEN);
+}
+
+void FunctionCallEvaluator::EmitSizeCode(CodeEmitter& out) const {
+  assert(IsSize());
+  out << "Builtin_StrlenAsSize(";
+  args_.at(0).EmitCode(out);
+  out << ")";
+}
+
+void FunctionCallEvaluator::EmitCode(CodeEmitter& out) const {
+  if (IsBuiltin(BuiltinType::EQUAL) && args_.at(0).IsSize() && args_.at(1).IsSize()) {
+    out << "Builtin_Equal(";
+    args_.at(0).EmitSizeCode(out);
+    out << ", ";
+    args_.at(1).EmitSizeCode(out);
+    out << ")";
+    return;
+  }
+  if (IsBuiltin(BuiltinType::SUBSTRING)) {
+    // Skip the round trip through a string for any index known up front.
+    const RValueEvaluator& start = args_.at(1);
+    const RValueEvaluator& end = args_.at(2);
+    if (start.HasDirectSubstringIndex() || end.HasDirectSubstringIndex()) {
+      out << "Builtin_Substring(";
+      args_.at(0).EmitCode(out);
+      out << ", ";
+      start.EmitSubstringIndexCode(out, /*is_start=*/true);
+      out << ", ";
+      end.EmitSubstringIndexCode(out, /*is_start=*/false);
+      out << ")";
+      return;
+    }
+  }
   const std::string* fn_name = std::get_if<std::string>(&fn_name_or_builtin_);
   if (fn_name != nullptr) {
-    code += *fn_name + kFnSuffix + "(";
+    out << *fn_name << kFnSuffix << "(";
   } else {
-    const BuiltinResolver* builtin = std::get_if<BuiltinResolver>(&fn_name_or_builtin_);
-    assert(builtin != nullptr);
-    code += builtin->GetCppName() + "(";
+    out << std::get<const NativeBuiltin*>(fn_name_or_builtin_)->cpp_name << "(";
   }
   for (int i = 0; i < args_.size(); ++i) {
-    code += args_.at(i).GetCode();
+    if (fn_name != nullptr) {
+      args_.at(i).EmitArgumentCode(out);
+    } else {
+      args_.at(i).EmitCode(out);
+    }
     if (i + 1 != args_.size()) {
-      code += ", ";
+      out << ", ";
+    }
+  }
+  out << ")";
+}
+
+namespace {
+
+Opcode GetBuiltinOpcode(BuiltinType type) {
+  switch (type) {
+    case BuiltinType::EQUAL: return Opcode::EQUAL;
+    case BuiltinType::PRINT: return Opcode::PRINT;
+    case BuiltinType::CONCAT: return Opcode::CONCAT;
+    case BuiltinType::NOT: return Opcode::NOT;
+    case BuiltinType::AND: return Opcode::AND;
+    case BuiltinType::OR: return Opcode::OR;
+    case BuiltinType::STRLEN: return Opcode::STRLEN;
+    case BuiltinType::SUBSTRING: return Opcode::SUBSTRING;
+    case BuiltinType::NATIVE: break;
+  }
+  // Bytecode is only generated with the core builtins.
+  assert(false);
+  __builtin_unreachable();
+}
+
+}  // namespace
+
+void FunctionCallEvaluator::EmitBytecode(BytecodeBuilder& out) const {
+  EmitBytecode(out, out.NewTemporary());
+}
+
+void FunctionCallEvaluator::EmitBytecode(BytecodeBuilder& out, uint32_t dst) const {
+  if (const std::string* fn_name = std::get_if<std::string>(&fn_name_or_builtin_)) {
+    // Arguments go in consecutive registers, which the callee starts from.
+    const uint32_t first_arg = out.NewTemporaries(args_.size());
+    for (size_t i = 0; i < args_.size(); ++i) {
+      args_[i].EmitBytecode(out, first_arg + i);
+    }
+    out.Emit(Opcode::CALL, dst, out.FunctionId(*fn_name), first_arg, args_.size());
+    return;
+  }
+  uint32_t operands[3] = {};
+  for (size_t i = 0; i < args_.size(); ++i) {
+    operands[i] = args_[i].EmitBytecodeOperand(out);
+  }
+  out.Emit(GetBuiltinOpcode(std::get<const NativeBuiltin*>(fn_name_or_builtin_)->type), dst,
+           operands[0], operands[1], operands[2]);
+}
+
+namespace {
+
+std::string IncrementCode(const FunctionProfile* profile, int counter) {
+  return profile == nullptr ? "" : profile->IncrementCode(counter);
+}
+
+// Hint for a branch taken `taken` times out of `total`, or nothing if the
+// profile doesn't lean either way.
+std::string GetBranchHint(uint64_t taken, uint64_t total) {
+  if (total == 0) {
+    return "";
+  }
+  if (taken * 10 >= total * 9) {
+    return " [[likely]]";
+  }
+  if (taken * 10 <= total) {
+    return " [[unlikely]]";
+  }
+  return "";
+}
+
+// If rvalue is EQUAL(variable, "literal") or EQUAL("literal", variable), and
+// the literal has no escape sequences, sets variable and literal and returns
+// true.
+bool GetEqualityTest(const RValue& rvalue, std::string& variable, std::string& literal) {
+  const auto& child = *rvalue.GetChildren().at(0);
+  if (child.GetLabel() != GrammarLabel::FUNCTION_CALL) {
+    return false;
+  }
+  const auto& fn = *child.GetChildren().at(0);
+  if (fn.GetLabel() != GrammarLabel::BUILTIN || strcmp(fn.GetContent(), "EQUAL") != 0) {
+    return false;
+  }
+  const std::vector<const RValue*> args =
+      ExpandRValueList(GetChild<RValueList, 2>(PieceCast<FunctionCall>(child)));
+  if (args.size() != 2) {
+    return false;
+  }
+  const auto& lhs = *args[0]->GetChildren().at(0);
+  const auto& rhs = *args[1]->GetChildren().at(0);
+  const bool literal_first = lhs.GetLabel() == GrammarLabel::QUOTED_STRING;
+  const auto& literal_piece = literal_first ? lhs : rhs;
+  const auto& variable_piece = literal_first ? rhs : lhs;
+  if (literal_piece.GetLabel() != GrammarLabel::QUOTED_STRING ||
+      variable_piece.GetLabel() != GrammarLabel::VARIABLE ||
+      strchr(literal_piece.GetContent(), '\\') != nullptr) {
+    return false;
+  }
+  variable = variable_piece.GetContent();
+  literal = literal_piece.GetContent();
+  return true;
+}
+
+// True if every condition compares the same variable against a different
+// literal. At most one of them can hold, and checking them has no side
+// effects, so they can be checked in any order.
+bool AreExclusiveEqualityTests(const std::vector<const RValue*>& conditions) {
+  std::string variable;
+  std::unordered_set<std::string> literals;
+  for (const RValue* condition : conditions) {
+    std::string curr_variable;
+    std::string literal;
+    if (!GetEqualityTest(*condition, curr_variable, literal)) {
+      return false;
+    }
+    if (variable.empty()) {
+      variable = curr_variable;
+    } else if (curr_variable != variable) {
+      return false;
+    }
+    if (!literals.insert(literal).second) {
+      return false;
     }
   }
-  code += ")";
-  return code;
+  return true;
 }
 
+}  // namespace
+
 class WhileEvaluator : public StatementEvaluator {
  public:
   static ErrorOr<WhileEvaluator> TryCreate(const ConditionalEvaluation& ce, const CodeBlock& cb,
                                            CompilationContext& context);
-  std::string GetCode() const override;
+  void EmitCode(CodeEmitter& out) const override;
+  void EmitBytecode(BytecodeBuilder& out) const override;
  private:
   RValueEvaluator conditional_;
   CodeBlockEvaluator cbe_;
+  const FunctionProfile* profile_{};
+  int entry_counter_ = -1;
+  int trip_counter_ = -1;
+  std::string hint_;
   WhileEvaluator(RValueEvaluator cond, CodeBlockEvaluator cbe) :
       conditional_(std::move(cond)), cbe_(std::move(cbe)) {}
 };
 
 ErrorOr<WhileEvaluator> WhileEvaluator::TryCreate(
     const ConditionalEvaluation& ce, const CodeBlock& cb, CompilationContext& context) {
-  const auto& ce_children = ce.GetChildren();
-  assert(ce_children.size() == 3);
-  auto conditional = RValueEvaluator::TryCreate(
-      dynamic_cast<const RValue&>(*ce_children[1]), context);
+  std::string counter_prefix;
+  if (context.profile != nullptr) {
+    counter_prefix = "while" + std::to_string(context.profile->NextLoopId()) + "/";
+  }
+  auto conditional = RValueEvaluator::TryCreate(GetChild<RValue, 1>(ce), context);
   RETURN_EC_IF_FAILURE(conditional);
-  CompilationContext inside_loop_context = context;
-  inside_loop_context.is_in_loop = true;
-  auto code = CodeBlockEvaluator::TryCreate(cb, std::move(inside_loop_context));
+  const bool was_in_loop = context.is_in_loop;
+  context.is_in_loop = true;
+  auto code = CodeBlockEvaluator::TryCreate(cb, context);
+  context.is_in_loop = was_in_loop;
   RETURN_EC_IF_FAILURE(code);
-  return WhileEvaluator(std::move(conditional.GetItem()), std::move(code.GetItem()));
+  WhileEvaluator evaluator(std::move(conditional.GetItem()), std::move(code.GetItem()));
+  if (context.profile != nullptr) {
+    FunctionProfile& profile = *context.profile;
+    evaluator.profile_ = &profile;
+    evaluator.entry_counter_ = profile.AddCounter(counter_prefix + "entry");
+    evaluator.trip_counter_ = profile.AddCounter(counter_prefix + "trip");
+    if (profile.feedback() != nullptr) {
+      // Every entry and every trip evaluates the condition once, ignoring
+      // BREAKs and RETURNs.
+      const uint64_t trips = profile.GetFeedbackCount(evaluator.trip_counter_).value();
+      const uint64_t entries = profile.GetFeedbackCount(evaluator.entry_counter_).value();
+      evaluator.hint_ = GetBranchHint(trips, trips + entries);
+    }
+  }
+  return evaluator;
+}
+
+void WhileEvaluator::EmitCode(CodeEmitter& out) const {
+  out << IncrementCode(profile_, entry_counter_) << "while (";
+  conditional_.EmitCode(out);
+  out << ")" << hint_ << " {\n" << IncrementCode(profile_, trip_counter_);
+  cbe_.EmitCode(out);
+  out << "}\n";
 }
 
-std::string WhileEvaluator::GetCode() const {
-  std::string code = "while (" + conditional_.GetCode() + ") {\n";
-  code += cbe_.GetCode();
-  code += "}\n";
-  return code;
+void WhileEvaluator::EmitBytecode(BytecodeBuilder& out) const {
+  const size_t start = out.NextInstruction();
+  const uint32_t condition = conditional_.EmitBytecodeOperand(out);
+  const size_t exit_jump = out.Emit(Opcode::JUMP_IF_FALSE, 0, condition);
+  out.ReleaseTemporaries();
+  out.StartLoop();
+  cbe_.EmitBytecode(out);
+  out.Emit(Opcode::JUMP, start);
+  out.SetJumpTarget(exit_jump, out.NextInstruction());
+  out.FinishLoop(out.NextInstruction());
 }
 
 class IfEvaluator : public StatementEvaluator {
  public:
   static ErrorOr<IfEvaluator> TryCreate(const ConditionalEvaluation& ce, const CodeBlock& cb,
                                         const ElseStatement& ee, CompilationContext& context);
-  std::string GetCode() const override;
+  void EmitCode(CodeEmitter& out) const override;
+  void EmitBytecode(BytecodeBuilder& out) const override;
  private:
   struct IfOrElse {
     std::optional<RValueEvaluator> maybe_conditional;
     CodeBlockEvaluator cbe;
+    int counter = -1;
+    std::string hint;
   };
   std::vector<IfOrElse> ifs_and_elses_;
+  const FunctionProfile* profile_{};
+  int entry_counter_ = -1;
   IfEvaluator(std::vector<IfOrElse> ioes) : ifs_and_elses_(std::move(ioes)) {}
+  // Puts the most frequently taken arms first when that can't change
+  // behavior, and hints each conditional arm.
+  void ApplyFeedback(bool arms_are_exclusive);
 };
 
 ErrorOr<IfEvaluator> IfEvaluator::TryCreate(const ConditionalEvaluation& ce, const CodeBlock& cb,
                                             const ElseStatement& ee, CompilationContext& context) {
   std::vector<IfOrElse> ifs_and_elses;
-  const auto& ce_children = ce.GetChildren();
-  assert(ce_children.size() == 3);
-  auto conditional = RValueEvaluator::TryCreate(
-      dynamic_cast<const RValue&>(*ce_children[1]), context);
+  std::vector<const RValue*> conditions;
+  std::string counter_prefix;
+  if (context.profile != nullptr) {
+    counter_prefix = "if" + std::to_string(context.profile->NextBranchId()) + "/";
+  }
+  conditions.push_back(&GetChild<RValue, 1>(ce));
+  auto conditional = RValueEvaluator::TryCreate(*conditions.back(), context);
   RETURN_EC_IF_FAILURE(conditional);
   auto code = CodeBlockEvaluator::TryCreate(cb, context);
   RETURN_EC_IF_FAILURE(code);
   ifs_and_elses.emplace_back(IfOrElse{
       std::move(conditional.GetItem()), std::move(code.GetItem())});
-  const auto* else_children = &ee.GetChildren();
-  while (else_children->size() != 0) {
-    if (else_children->size() == 2) {
+  const ElseStatement* else_statement = &ee;
+  while (else_statement->GetChildren().size() != 0) {
+    if (else_statement->GetChildren().size() == 2) {
       // ELSE statement.
       auto elsecode = CodeBlockEvaluator::TryCreate(
-          dynamic_cast<const CodeBlock&>(*else_children->at(1)), context);
+          GetChild<CodeBlock, 1>(*else_statement), context);
       RETURN_EC_IF_FAILURE(elsecode);
       ifs_and_elses.emplace_back(IfOrElse{std::nullopt, std::move(elsecode.GetItem())});
       break;
     }
     // ELIF statement.
-    assert(else_children->size() == 4);
-    const auto& additional_conditional = dynamic_cast<const ConditionalEvaluation&>(
-        *else_children->at(1));
-    assert(additional_conditional.GetChildren().size() == 3);
-    auto else_conditional = RValueEvaluator::TryCreate(
-        dynamic_cast<const RValue&>(*additional_conditional.GetChildren()[1]), context);
+    conditions.push_back(&GetChild<RValue, 1>(GetChild<ConditionalEvaluation, 1>(*else_statement)));
+    auto else_conditional = RValueEvaluator::TryCreate(*conditions.back(), context);
     RETURN_EC_IF_FAILURE(else_conditional);
     auto else_code = CodeBlockEvaluator::TryCreate(
-        dynamic_cast<const CodeBlock&>(*else_children->at(2)), context);
+        GetChild<CodeBlock, 2>(*else_statement), context);
     RETURN_EC_IF_FAILURE(else_code);
     ifs_and_elses.emplace_back(IfOrElse{
         std::move(else_conditional.GetItem()), std::move(else_code.GetItem())});
-    const auto& additonal_else = dynamic_cast<const ElseStatement&>(*else_children->at(3));
-    else_children = &additonal_else.GetChildren();
+    else_statement = &GetChild<ElseStatement, 3>(*else_statement);
+  }
+  IfEvaluator evaluator(std::move(ifs_and_elses));
+  if (context.profile != nullptr) {
+    FunctionProfile& profile = *context.profile;
+    evaluator.profile_ = &profile;
+    evaluator.entry_counter_ = profile.AddCounter(counter_prefix + "entry");
+    // Arms are named by their position in the source, not in the output.
+    for (size_t i = 0; i < evaluator.ifs_and_elses_.size(); ++i) {
+      evaluator.ifs_and_elses_[i].counter = profile.AddCounter(
+          counter_prefix + "arm" + std::to_string(i));
+    }
+    if (profile.feedback() != nullptr) {
+      evaluator.ApplyFeedback(conditions.size() > 1 && AreExclusiveEqualityTests(conditions));
+    }
+  }
+  return evaluator;
+}
+
+void IfEvaluator::ApplyFeedback(bool arms_are_exclusive) {
+  auto get_count = [this](const IfOrElse& iae) {
+    return profile_->GetFeedbackCount(iae.counter).value();
+  };
+  if (arms_are_exclusive) {
+    // ELSE stays last.
+    auto conditionals_end = ifs_and_elses_.back().maybe_conditional.has_value() ?
+        ifs_and_elses_.end() : ifs_and_elses_.end() - 1;
+    std::stable_sort(ifs_and_elses_.begin(), conditionals_end,
+                     [&get_count](const IfOrElse& lhs, const IfOrElse& rhs) {
+                       return get_count(lhs) > get_count(rhs);
+                     });
+  }
+  // No hint for ELSE, since GCC complains when it hints the same way as the
+  // arm before it.
+  uint64_t reaching = profile_->GetFeedbackCount(entry_counter_).value();
+  for (IfOrElse& iae : ifs_and_elses_) {
+    if (!iae.maybe_conditional.has_value()) {
+      break;
+    }
+    const uint64_t taken = std::min(get_count(iae), reaching);
+    iae.hint = GetBranchHint(taken, reaching);
+    reaching -= taken;
   }
-  return IfEvaluator(std::move(ifs_and_elses));
 }
 
-std::string IfEvaluator::GetCode() const {
-  std::string code = "if (" + ifs_and_elses_.at(0).maybe_conditional.value().GetCode() + ") {\n";
-  code += ifs_and_elses_.at(0).cbe.GetCode();
-  code += "}";
-  for (int i = 1; i < ifs_and_elses_.size(); ++i) {
+void IfEvaluator::EmitCode(CodeEmitter& out) const {
+  out << IncrementCode(profile_, entry_counter_);
+  for (size_t i = 0; i < ifs_and_elses_.size(); ++i) {
     const auto& iae = ifs_and_elses_.at(i);
     if (iae.maybe_conditional.has_value()) {
-      code += " else if (" + iae.maybe_conditional.value().GetCode() + ") {\n";
+      out << (i == 0 ? "if (" : " else if (");
+      iae.maybe_conditional.value().EmitCode(out);
+      out << ")" << iae.hint << " {\n";
     } else {
-      code += " else {\n";
+      out << " else {\n";
+    }
+    out << IncrementCode(profile_, iae.counter);
+    iae.cbe.EmitCode(out);
+    out << "}";
+  }
+  out << "\n";
+}
+
+void IfEvaluator::EmitBytecode(BytecodeBuilder& out) const {
+  std::vector<size_t> exit_jumps;
+  for (size_t i = 0; i < ifs_and_elses_.size(); ++i) {
+    const auto& iae = ifs_and_elses_.at(i);
+    std::optional<size_t> skip_jump;
+    if (iae.maybe_conditional.has_value()) {
+      const uint32_t condition = iae.maybe_conditional.value().EmitBytecodeOperand(out);
+      skip_jump = out.Emit(Opcode::JUMP_IF_FALSE, 0, condition);
+      out.ReleaseTemporaries();
     }
-    code += iae.cbe.GetCode();
-    code += "}";
+    iae.cbe.EmitBytecode(out);
+    if (i + 1 != ifs_and_elses_.size()) {
+      exit_jumps.push_back(out.Emit(Opcode::JUMP));
+    }
+    if (skip_jump.has_value()) {
+      out.SetJumpTarget(*skip_jump, out.NextInstruction());
+    }
+  }
+  for (const size_t jump : exit_jumps) {
+    out.SetJumpTarget(jump, out.NextInstruction());
   }
-  code += "\n";
-  return code;
 }
 
 class ReturnEvaluator : public StatementEvaluator {
  public:
   static ErrorOr<ReturnEvaluator> TryCreate(const RValue& rvalue, CompilationContext& context);
-  std::string GetCode() const override;
+  void EmitCode(CodeEmitter& out) const override;
+  void EmitBytecode(BytecodeBuilder& out) const override;
  private:
   ReturnEvaluator(RValueEvaluator rve) : rve_(std::move(rve)) {}
   RValueEvaluator rve_;
@@ -453,15 +858,23 @@ ErrorOr<ReturnEvaluator> ReturnEvaluator::TryCreate(
   return ReturnEvaluator(std::move(rve.GetItem()));
 }
 
-std::string ReturnEvaluator::GetCode() const {
-  return "return " + rve_.GetCode() + ";\n";
+void ReturnEvaluator::EmitCode(CodeEmitter& out) const {
+  out << "return ";
+  rve_.EmitCode(out);
+  out << ";\n";
+}
+
+void ReturnEvaluator::EmitBytecode(BytecodeBuilder& out) const {
+  const uint32_t result = rve_.EmitBytecodeOperand(out);
+  out.Emit(Opcode::RETURN, result);
 }
 
 class BreakEvaluator : public StatementEvaluator {
  public:
   static ErrorOr<BreakEvaluator> TryCreate(
       size_t line_num, std::string file, CompilationContext& context);
-  std::string GetCode() const override;
+  void EmitCode(CodeEmitter& out) const override;
+  void EmitBytecode(BytecodeBuilder& out) const override;
  private:
   BreakEvaluator() {}
 };
@@ -475,89 +888,97 @@ ErrorOr<BreakEvaluator> BreakEvaluator::TryCreate(
   return BreakEvaluator();
 }
 
-std::string BreakEvaluator::GetCode() const {
-  return "break;\n";
+void BreakEvaluator::EmitCode(CodeEmitter& out) const {
+  out << "break;\n";
+}
+
+void BreakEvaluator::EmitBytecode(BytecodeBuilder& out) const {
+  out.AddBreak(out.Emit(Opcode::JUMP));
+}
+
+namespace {
+
+// Moves a statement's evaluator behind a StatementEvaluator pointer.
+template <typename Evaluator>
+ErrorOr<std::unique_ptr<StatementEvaluator>> ToStatementEvaluator(ErrorOr<Evaluator> eval) {
+  RETURN_EC_IF_FAILURE(eval);
+  return std::unique_ptr<StatementEvaluator>(
+      std::make_unique<Evaluator>(std::move(eval.GetItem())));
 }
 
+}  // namespace
+
 ErrorOr<std::unique_ptr<StatementEvaluator>> StatementEvaluator::TryCreate(
     const Statement& statement, CompilationContext& context) {
-  using ReturnVal = std::unique_ptr<StatementEvaluator>;
-  const auto& children = statement.GetChildren();
-  assert(children.size() > 0);
-  auto label = children[0]->GetLabel();
-  if (label == GrammarLabel::VARIABLE_ASSIGNMENT) {
-    auto eval = VariableAssignmentEvaluator::TryCreate(
-        dynamic_cast<const VariableAssignment&>(*children[0]), context);
-    RETURN_EC_IF_FAILURE(eval);
-    return ReturnVal(std::make_unique<VariableAssignmentEvaluator>(std::move(eval.GetItem())));
-  } else if (label == GrammarLabel::GLOBAL_DECLARATION) {
-    auto eval = GlobalDeclarationEvaluator::TryCreate(
-      dynamic_cast<const GlobalDeclaration&>(*children[0]), context);
-    RETURN_EC_IF_FAILURE(eval);
-    return ReturnVal(std::make_unique<GlobalDeclarationEvaluator>(std::move(eval.GetItem())));
-  } else if (label == GrammarLabel::FUNCTION_CALL) {
-    auto eval = FunctionCallEvaluator::TryCreate(
-        dynamic_cast<const FunctionCall&>(*children[0]), context);
-    RETURN_EC_IF_FAILURE(eval);
-    return ReturnVal(std::make_unique<FunctionCallEvaluator>(std::move(eval.GetItem())));
-  } else if (label == GrammarLabel::KEYWORD_WHILE) {
-    assert(children.size() == 3);
-    auto eval = WhileEvaluator::TryCreate(
-        dynamic_cast<const ConditionalEvaluation&>(*children[1]),
-        dynamic_cast<const CodeBlock&>(*children[2]), context);
-    RETURN_EC_IF_FAILURE(eval);
-    return ReturnVal(std::make_unique<WhileEvaluator>(std::move(eval.GetItem())));
-  } else if (label == GrammarLabel::KEYWORD_IF) {
-    assert(children.size() == 4);
-    auto eval = IfEvaluator::TryCreate(
-        dynamic_cast<const ConditionalEvaluation&>(*children[1]),
-        dynamic_cast<const CodeBlock&>(*children[2]),
-        dynamic_cast<const ElseStatement&>(*children[3]), context);
-    RETURN_EC_IF_FAILURE(eval);
-    return ReturnVal(std::make_unique<IfEvaluator>(std::move(eval.GetItem())));
-  } else if (label == GrammarLabel::KEYWORD_RETURN) {
-    assert(children.size() == 3);
-    auto eval = ReturnEvaluator::TryCreate(
-        dynamic_cast<const RValue&>(*children[1]), context);
-    RETURN_EC_IF_FAILURE(eval);
-    return ReturnVal(std::make_unique<ReturnEvaluator>(std::move(eval.GetItem())));
-  } else if (label == GrammarLabel::KEYWORD_BREAK) {
-    auto eval = BreakEvaluator::TryCreate(
-        children[0]->line_number(), children[0]->file_name(), context);
-    RETURN_EC_IF_FAILURE(eval);
-    return ReturnVal(std::make_unique<BreakEvaluator>(std::move(eval.GetItem())));
-  }
-  assert(false);
+  return VisitChild<0, VariableAssignment, GlobalDeclaration, FunctionCall, KeywordWhile,
+                    KeywordIf, KeywordReturn, KeywordBreak>(statement, Visitor{
+      [&](const VariableAssignment& va) {
+        return ToStatementEvaluator(VariableAssignmentEvaluator::TryCreate(va, context));
+      },
+      [&](const GlobalDeclaration& gd) {
+        return ToStatementEvaluator(GlobalDeclarationEvaluator::TryCreate(gd, context));
+      },
+      [&](const FunctionCall& fc) -> ErrorOr<std::unique_ptr<StatementEvaluator>> {
+        auto call = FunctionCallEvaluator::TryCreate(fc, context);
+        RETURN_EC_IF_FAILURE(call);
+        // Nothing reads the result, so a call without side effects does nothing.
+        if (call.GetItem().IsPure()) {
+          return std::unique_ptr<StatementEvaluator>();
+        }
+        return ToStatementEvaluator(std::move(call));
+      },
+      [&](const KeywordWhile&) {
+        return ToStatementEvaluator(WhileEvaluator::TryCreate(
+            GetChild<ConditionalEvaluation, 1>(statement), GetChild<CodeBlock, 2>(statement),
+            context));
+      },
+      [&](const KeywordIf&) {
+        return ToStatementEvaluator(IfEvaluator::TryCreate(
+            GetChild<ConditionalEvaluation, 1>(statement), GetChild<CodeBlock, 2>(statement),
+            GetChild<ElseStatement, 3>(statement), context));
+      },
+      [&](const KeywordReturn&) {
+        return ToStatementEvaluator(
+            ReturnEvaluator::TryCreate(GetChild<RValue, 1>(statement), context));
+      },
+      [&](const KeywordBreak& keyword) {
+        return ToStatementEvaluator(
+            BreakEvaluator::TryCreate(keyword.line_number(), keyword.file_name(), context));
+      }});
 }
 
 ErrorOr<CodeBlockEvaluator> CodeBlockEvaluator::TryCreate(
-    const CodeBlock& code_block, CompilationContext context) {
+    const CodeBlock& code_block, CompilationContext& context) {
+  ScopedSymbolTable::Scope scope(*context.symbols);
   std::vector<std::unique_ptr<StatementEvaluator>> evaluators;
-  assert(code_block.GetChildren().size() == 3);
-  const StatementList* statement_list = &dynamic_cast<const StatementList&>(
-    *code_block.GetChildren()[1]);
-  while (statement_list->GetChildren().size() != 0) {
-    const auto& children = statement_list->GetChildren();
-    assert(children.size() == 2);
+  const auto& statements = GetChild<StatementList, 1>(code_block).GetChildren();
+  evaluators.reserve(statements.size());
+  for (const GrammarPiece* statement : statements) {
     auto statement_evaluator = StatementEvaluator::TryCreate(
-      dynamic_cast<const Statement&>(*children[0]), context);
+      PieceCast<Statement>(*statement), context);
     RETURN_EC_IF_FAILURE(statement_evaluator);
-    evaluators.push_back(std::move(statement_evaluator.GetItem()));
-    statement_list = &dynamic_cast<const StatementList&>(*children[1]);
+    if (statement_evaluator.GetItem() != nullptr) {
+      evaluators.push_back(std::move(statement_evaluator.GetItem()));
+    }
   }
   return CodeBlockEvaluator(std::move(evaluators));
 }
 
-std::string CodeBlockEvaluator::GetCode() const {
-  std::string code;
+void CodeBlockEvaluator::EmitCode(CodeEmitter& out) const {
   for (const auto& evaluator : evaluators_) {
-    code += evaluator->GetCode();
-    if (dynamic_cast<FunctionCallEvaluator*>(evaluator.get()) != nullptr) {
-      code += ";";
+    evaluator->EmitCode(out);
+    if (evaluator->IsExpression()) {
+      out << ";";
     }
-    code += "\n";
+    out << "\n";
+  }
+}
+
+void CodeBlockEvaluator::EmitBytecode(BytecodeBuilder& out) const {
+  for (const auto& evaluator : evaluators_) {
+    evaluator->EmitBytecode(out);
+    out.ReleaseTemporaries();
   }
-  return code;
 }
 
 }  // namespace pbc
@@ -20,6 +20,8 @@ limitations under the License.
 #include <string>
 #include <vector>
 
+#include "bytecode.h"
+#include "code_emitter.h"
 #include "error_code.h"
 #include "grammar.h"
 #include "interpretation_context.h"
@@ -28,17 +30,22 @@ namespace pbc {
 
 class StatementEvaluator {
  public:
+  // Null for a statement with no effect, which needs no code.
   static ErrorOr<std::unique_ptr<StatementEvaluator>> TryCreate(
     const Statement& statement, CompilationContext& context);
-  virtual std::string GetCode() const = 0;
+  virtual void EmitCode(CodeEmitter& out) const = 0;
+  virtual void EmitBytecode(BytecodeBuilder& out) const = 0;
+  // Whether EmitCode leaves off the ; since the statement is a bare expression.
+  virtual bool IsExpression() const { return false; }
   virtual ~StatementEvaluator() {}
 };
 
 class CodeBlockEvaluator {
  public:
   static ErrorOr<CodeBlockEvaluator> TryCreate(
-    const CodeBlock& code_block, CompilationContext context);
-  std::string GetCode() const;
+    const CodeBlock& code_block, CompilationContext& context);
+  void EmitCode(CodeEmitter& out) const;
+  void EmitBytecode(BytecodeBuilder& out) const;
  private:
   CodeBlockEvaluator(std::vector<std::unique_ptr<StatementEvaluator>> e) :
       evaluators_(std::move(e)) {}
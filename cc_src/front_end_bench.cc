@@ -0,0 +1,129 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Times the stages of the front end on the given files, each run repeatedly
+// with the best time kept. Built and run by bench.py.
+//   front_end_bench [--repeat=N] [--parse] in.poiboi...
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "grammar.h"
+#include "parser.h"
+#include "scanner.h"
+#include "source_file.h"
+#include "structural_index.h"
+#include "tokens.h"
+
+namespace pbc {
+namespace {
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void PrintThroughput(const char* stage, double seconds, size_t num_bytes, size_t num_tokens) {
+  std::printf("%-8s %8.3fs  %7.2f GB/s  %9.2f M tokens/s\n", stage, seconds,
+              num_bytes / seconds / 1e9, num_tokens / seconds / 1e6);
+}
+
+}  // namespace
+}  // namespace pbc
+
+int main(int argc, char** argv) {
+  constexpr std::string_view kRepeat = "--repeat=";
+  int repeat = 5;
+  bool parse = false;
+  std::vector<pbc::SourceFile> sources;
+  std::vector<std::string_view> codes;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with(kRepeat)) {
+      repeat = std::max(1, std::stoi(std::string(arg.substr(kRepeat.size()))));
+      continue;
+    } else if (arg == "--parse") {
+      parse = true;
+      continue;
+    }
+    pbc::ErrorOr<pbc::SourceFile> source = pbc::SourceFile::Open(argv[i]);
+    if (source.IsFailure()) {
+      std::cerr << source.ErrorMessage() << std::endl;
+      return 2;
+    }
+    sources.push_back(std::move(source.GetItem()));
+    codes.push_back(sources.back().code());
+  }
+  if (codes.empty()) {
+    std::cerr << "Usage: front_end_bench [--repeat=N] [--parse] in.poiboi..." << std::endl;
+    return 1;
+  }
+  size_t num_bytes = 0;
+  for (const std::string_view code : codes) {
+    num_bytes += code.size();
+  }
+
+  double best_index = 1e300;
+  double best_scan = 1e300;
+  double best_parse = 1e300;
+  size_t num_tokens = 0;
+  std::vector<std::vector<pbc::Token>> tokens(codes.size());
+  pbc::StructuralIndex index;
+  for (int r = 0; r < repeat; ++r) {
+    // Just the first pass of scanning.
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string_view code : codes) {
+      pbc::BuildStructuralIndex(code, index);
+    }
+    best_index = std::min(best_index, pbc::SecondsSince(start));
+    num_tokens = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < codes.size(); ++i) {
+      const pbc::ErrorCode ec = pbc::ScanTokens(codes[i], tokens[i]);
+      if (ec.IsFailure()) {
+        std::cerr << ec.ErrorMessage() << std::endl;
+        return 3;
+      }
+      num_tokens += tokens[i].size();
+    }
+    best_scan = std::min(best_scan, pbc::SecondsSince(start));
+    if (!parse) {
+      continue;
+    }
+    std::vector<pbc::Module> modules(codes.size());
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < codes.size(); ++i) {
+      const pbc::ErrorCode ec = pbc::ParseTokens(tokens[i], codes[i], "bench", modules[i]);
+      if (ec.IsFailure()) {
+        std::cerr << ec.ErrorMessage() << std::endl;
+        return 4;
+      }
+    }
+    best_parse = std::min(best_parse, pbc::SecondsSince(start));
+  }
+  std::printf("%zu bytes, %zu tokens of %zu bytes each, best of %d\n", num_bytes, num_tokens,
+              sizeof(pbc::Token), repeat);
+  pbc::PrintThroughput("index", best_index, num_bytes, num_tokens);
+  pbc::PrintThroughput("scan", best_scan, num_bytes, num_tokens);
+  if (parse) {
+    pbc::PrintThroughput("parse", best_parse, num_bytes, num_tokens);
+  }
+  return 0;
+}
@@ -16,42 +16,25 @@ limitations under the License.
 
 #include "function.h"
 
-namespace pbc {
-namespace {
-std::vector<std::string> GenerateVariablesList(const VariablesList& variables) {
-  std::vector<std::string> names;
-  const auto& children = variables.GetChildren();
-  if (children.size() == 0) {
-    return names;
-  }
+#include <cassert>
 
-  assert(children.size() == 2);
-  assert(children[0]->GetLabel() == GrammarLabel::VARIABLE);
-  names.push_back(children[0]->GetContent());
+#include "tokens.h"
 
-  const auto* expansion = &dynamic_cast<const VariablesListExpansion&>(*children[1]);
-  for (; ;) {
-    const auto& exp_children = expansion->GetChildren();
-    if (exp_children.empty()) {
-      return names;
-    }
-    assert(exp_children[1]->GetLabel() == GrammarLabel::VARIABLE);
-    names.push_back(exp_children[1]->GetContent());
-    expansion = &dynamic_cast<const VariablesListExpansion&>(*exp_children[2]);
-  }
-}
-}  // namespace
+namespace pbc {
 
 Function::Function(const FunctionDefinition& fn_def) {
-  const auto& children = fn_def.GetChildren();
-  assert(children.size() == 5);
-  assert(children[0]->GetLabel() == GrammarLabel::FUNCTION_NAME);
-  name_ = children[0]->GetContent();
+  name_ = GetChild<FunctionName, 0>(fn_def).GetContent();
 
-  variables_list_ = GenerateVariablesList(dynamic_cast<const VariablesList&>(*children[2]));
+  const auto& variables = GetChild<VariablesList, 2>(fn_def).GetChildren();
+  variables_list_.reserve(variables.size());
+  variable_symbols_.reserve(variables.size());
+  for (const GrammarPiece* piece : variables) {
+    const Variable& variable = PieceCast<Variable>(*piece);
+    variables_list_.push_back(variable.GetContent());
+    variable_symbols_.push_back(variable.symbol());
+  }
 
-  assert(children[4]->GetLabel() == GrammarLabel::CODE_BLOCK);
-  code_ = &dynamic_cast<const CodeBlock&>(*children[4]);
+  code_ = &GetChild<CodeBlock, 4>(fn_def);
 
   file_name_ = fn_def.file_name();
   line_num_ = fn_def.line_number();
@@ -60,16 +43,8 @@ Function::Function(const FunctionDefinition& fn_def) {
 std::vector<Function> GetFunctionsFromModules(const std::vector<Module>& modules) {
   std::vector<Function> functions;
   for (const Module& root : modules) {
-    const Module* curr_module = &root;
-    for (; ;) {
-      const auto& children = curr_module->GetChildren();
-      if (children.size() == 1) {
-        assert(children[0]->GetLabel() == GrammarLabel::END_OF_FILE);
-        break;
-      }
-      assert(children.size() == 2);
-      functions.emplace_back(dynamic_cast<const FunctionDefinition&>(*children[0]));
-      curr_module = &dynamic_cast<const Module&>(*children[1]);
+    for (const GrammarPiece* fn_def : root.GetChildren()) {
+      functions.emplace_back(PieceCast<FunctionDefinition>(*fn_def));
     }
   }
   return functions;
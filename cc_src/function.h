@@ -31,6 +31,8 @@ class Function {
   Function(const FunctionDefinition& fn_def);
   const std::string& GetName() const { return name_; }
   const std::vector<std::string>& GetVariablesList() const { return variables_list_; }
+  // The symbols of GetVariablesList().
+  const std::vector<Symbol>& GetVariableSymbols() const { return variable_symbols_; }
   const CodeBlock& GetCode() const { return *code_; }
 
   const std::string& GetFileName() const { return file_name_; }
@@ -40,6 +42,7 @@ class Function {
  private:
   std::string name_;
   std::vector<std::string> variables_list_;
+  std::vector<Symbol> variable_symbols_;
   const CodeBlock* code_{};
 
   std::string file_name_;
@@ -20,223 +20,46 @@ limitations under the License.
 
 namespace pbc {
 
-GrammarPiece::Descendents Module::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new EndOfFile);
-
-  d.emplace_back();
-  d.back().emplace_back(new FunctionDefinition);
-  d.back().emplace_back(new Module);
-
-  return d;
-}
-
-GrammarPiece::Descendents FunctionDefinition::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new FunctionName);
-  d.back().emplace_back(new OpenFunctionCall);
-  d.back().emplace_back(new VariablesList);
-  d.back().emplace_back(new CloseFunctionCall);
-  d.back().emplace_back(new CodeBlock);
-
-  return d;
-}
-
-GrammarPiece::Descendents VariablesList::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new Variable);
-  d.back().emplace_back(new VariablesListExpansion);
-
-  d.emplace_back();
-
-  return d;
-}
-
-GrammarPiece::Descendents VariablesListExpansion::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new ArgumentListSeparator);
-  d.back().emplace_back(new Variable);
-  d.back().emplace_back(new VariablesListExpansion);
-
-  d.emplace_back();
-
-  return d;
-}
-
-GrammarPiece::Descendents CodeBlock::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new OpenCodeBlock);
-  d.back().emplace_back(new StatementList);
-  d.back().emplace_back(new CloseCodeBlock);
-
-  return d;
-}
-
-GrammarPiece::Descendents StatementList::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new Statement);
-  d.back().emplace_back(new StatementList);
-
-  d.emplace_back();
-
-  return d;
-}
-
-GrammarPiece::Descendents Statement::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new VariableAssignment);
-  d.back().emplace_back(new EndStatement);
-
-  d.emplace_back();
-  d.back().emplace_back(new GlobalDeclaration);
-  d.back().emplace_back(new EndStatement);
-
-  d.emplace_back();
-  d.back().emplace_back(new FunctionCall);
-  d.back().emplace_back(new EndStatement);
-
-  d.emplace_back();
-  d.back().emplace_back(new KeywordWhile);
-  d.back().emplace_back(new ConditionalEvaluation);
-  d.back().emplace_back(new CodeBlock);
-
-  d.emplace_back();
-  d.back().emplace_back(new KeywordIf);
-  d.back().emplace_back(new ConditionalEvaluation);
-  d.back().emplace_back(new CodeBlock);
-  d.back().emplace_back(new ElseStatement);
-
-  d.emplace_back();
-  d.back().emplace_back(new KeywordReturn);
-  d.back().emplace_back(new RValue);
-  d.back().emplace_back(new EndStatement);
-
-  d.emplace_back();
-  d.back().emplace_back(new KeywordBreak);
-  d.back().emplace_back(new EndStatement);
-
-  return d;
-}
-
-GrammarPiece::Descendents VariableAssignment::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new Variable);
-  d.back().emplace_back(new Assigner);
-  d.back().emplace_back(new RValue);
-
-  return d;
-}
-
-GrammarPiece::Descendents GlobalDeclaration::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new KeywordGlobal);
-  d.back().emplace_back(new Variable);
-
-  return d;
+GrammarPiece* CreateGrammarPiece(GrammarLabel label, AstArena& arena) {
+  switch (label) {
+    case GrammarLabel::OPEN_CODE_BLOCK: return arena.New<OpenCodeBlock>();
+    case GrammarLabel::CLOSE_CODE_BLOCK: return arena.New<CloseCodeBlock>();
+    case GrammarLabel::END_STATEMENT: return arena.New<EndStatement>();
+    case GrammarLabel::OPEN_FUNCTION_CALL: return arena.New<OpenFunctionCall>();
+    case GrammarLabel::CLOSE_FUNCTION_CALL: return arena.New<CloseFunctionCall>();
+    case GrammarLabel::ARGUMENT_LIST_SEPARATOR: return arena.New<ArgumentListSeparator>();
+    case GrammarLabel::OPEN_CONDITIONAL_BLOCK: return arena.New<OpenConditionalBlock>();
+    case GrammarLabel::CLOSE_CONDITIONAL_BLOCK: return arena.New<CloseConditionalBlock>();
+    case GrammarLabel::ASSIGNER: return arena.New<Assigner>();
+    case GrammarLabel::KEYWORD_GLOBAL: return arena.New<KeywordGlobal>();
+    case GrammarLabel::KEYWORD_WHILE: return arena.New<KeywordWhile>();
+    case GrammarLabel::KEYWORD_IF: return arena.New<KeywordIf>();
+    case GrammarLabel::KEYWORD_ELSE: return arena.New<KeywordElse>();
+    case GrammarLabel::KEYWORD_ELIF: return arena.New<KeywordElif>();
+    case GrammarLabel::KEYWORD_RETURN: return arena.New<KeywordReturn>();
+    case GrammarLabel::KEYWORD_BREAK: return arena.New<KeywordBreak>();
+    case GrammarLabel::QUOTED_STRING: return arena.New<QuotedString>();
+    case GrammarLabel::VARIABLE: return arena.New<Variable>();
+    case GrammarLabel::BUILTIN: return arena.New<Builtin>();
+    case GrammarLabel::FUNCTION_NAME: return arena.New<FunctionName>();
+    case GrammarLabel::END_OF_FILE: return arena.New<EndOfFile>();
+    case GrammarLabel::MODULE: return arena.New<Module>();
+    case GrammarLabel::FUNCTION_DEFINITION: return arena.New<FunctionDefinition>();
+    case GrammarLabel::VARIABLES_LIST: return arena.New<VariablesList>();
+    case GrammarLabel::CODE_BLOCK: return arena.New<CodeBlock>();
+    case GrammarLabel::STATEMENT_LIST: return arena.New<StatementList>();
+    case GrammarLabel::STATEMENT: return arena.New<Statement>();
+    case GrammarLabel::VARIABLE_ASSIGNMENT: return arena.New<VariableAssignment>();
+    case GrammarLabel::GLOBAL_DECLARATION: return arena.New<GlobalDeclaration>();
+    case GrammarLabel::FUNCTION_CALL: return arena.New<FunctionCall>();
+    case GrammarLabel::CONDITIONAL_EVALUATOR: return arena.New<ConditionalEvaluation>();
+    case GrammarLabel::ELSE_STATEMENT: return arena.New<ElseStatement>();
+    case GrammarLabel::RVALUE: return arena.New<RValue>();
+    case GrammarLabel::RVALUE_LIST: return arena.New<RValueList>();
+    case GrammarLabel::VARIABLES_LIST_EXPANSION:
+    case GrammarLabel::RVALUE_LIST_EXPANSION: return nullptr;
+  }
+  return nullptr;
 }
 
-GrammarPiece::Descendents FunctionCall::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new FunctionName);
-  d.back().emplace_back(new OpenFunctionCall);
-  d.back().emplace_back(new RValueList);
-  d.back().emplace_back(new CloseFunctionCall);
-
-  d.emplace_back();
-  d.back().emplace_back(new Builtin);
-  d.back().emplace_back(new OpenFunctionCall);
-  d.back().emplace_back(new RValueList);
-  d.back().emplace_back(new CloseFunctionCall);
-
-  return d;
-}
-
-GrammarPiece::Descendents ConditionalEvaluation::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new OpenConditionalBlock);
-  d.back().emplace_back(new RValue);
-  d.back().emplace_back(new CloseConditionalBlock);
-
-  return d;
-}
-
-GrammarPiece::Descendents ElseStatement::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new KeywordElse);
-  d.back().emplace_back(new CodeBlock);
-
-  d.emplace_back();
-  d.back().emplace_back(new KeywordElif);
-  d.back().emplace_back(new ConditionalEvaluation);
-  d.back().emplace_back(new CodeBlock);
-  d.back().emplace_back(new ElseStatement);
-
-  d.emplace_back();
-
-  return d;
-}
-
-GrammarPiece::Descendents RValue::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new QuotedString);
-
-  d.emplace_back();
-  d.back().emplace_back(new Variable);
-
-  d.emplace_back();
-  d.back().emplace_back(new FunctionCall);
-
-  return d;
-}
-
-GrammarPiece::Descendents RValueList::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new RValue);
-  d.back().emplace_back(new RValueListExpansion);
-
-  d.emplace_back();
-
-  return d;
-}
-
-GrammarPiece::Descendents RValueListExpansion::GetDescendents() const {
-  Descendents d;
-
-  d.emplace_back();
-  d.back().emplace_back(new ArgumentListSeparator);
-  d.back().emplace_back(new RValue);
-  d.back().emplace_back(new RValueListExpansion);
-
-  d.emplace_back();
-
-  return d;
-}
 }  // namespace pbc
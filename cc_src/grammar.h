@@ -15,13 +15,16 @@ limitations under the License.
 */
 
 // Defines the full expansion of the PoiBoi grammar. Everything terminates
-// as tokens.
+// as tokens. The expansions themselves are listed in kProductions.
 
 #ifndef POIBOIC_GRAMMAR_H_
 #define POIBOIC_GRAMMAR_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "grammar_piece.h"
@@ -31,32 +34,39 @@ namespace pbc {
 template<typename Descendent>
 class ExpandableGrammarPiece : public GrammarPiece {
  public:
-  std::unique_ptr<GrammarPiece> Clone() const override {
-    std::unique_ptr<GrammarPiece> gp(new Descendent);
-    CloneGPBase(gp.get());
-    return gp;
-  }
+  ExpandableGrammarPiece() : GrammarPiece(Descendent::kLabel) {}
 };
 
-// Represents a valid PoiBoi file. Just a series of function definitions.
+// Represents a valid PoiBoi file. Just a series of function definitions, which
+// are its children. The root of a file's tree owns the arena the rest of the
+// tree is in.
 class Module : public ExpandableGrammarPiece<Module> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override { return GrammarLabel::MODULE; }
+  static constexpr GrammarLabel kLabel = GrammarLabel::MODULE;
+
   const char* DebugDescription() const override {
     return "Zero or more function definitions, eg: functionDefinition1() {} "
            "functionDefinition2() {}";
   }
+
+  // Created on first use, so only roots have one.
+  AstArena& arena() {
+    if (arena_ == nullptr) {
+      arena_ = std::make_unique<AstArena>();
+    }
+    return *arena_;
+  }
+
+ private:
+  std::unique_ptr<AstArena> arena_;
 };
 
 // Function definitions have the function name, argument list, and the code
 // which defines the function.
 class FunctionDefinition : public ExpandableGrammarPiece<FunctionDefinition> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::FUNCTION_DEFINITION;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::FUNCTION_DEFINITION;
+
   const char* DebugDescription() const override {
     return "A function definition, eg: functionDefinition() {}";
   }
@@ -66,48 +76,32 @@ class FunctionDefinition : public ExpandableGrammarPiece<FunctionDefinition> {
 // 1. Empty
 // 2. Contain exactly one variable
 // 3. Contain multiple variables separated by commas.
+// The variables are its children; the commas aren't kept.
 class VariablesList : public ExpandableGrammarPiece<VariablesList> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::VARIABLES_LIST;
-  }
-  const char* DebugDescription() const override {
-    return "A list of zero or more variables, eg: a, b, c";
-  }
-};
+  static constexpr GrammarLabel kLabel = GrammarLabel::VARIABLES_LIST;
 
-class VariablesListExpansion
-      : public ExpandableGrammarPiece<VariablesListExpansion> {
- public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::VARIABLES_LIST_EXPANSION;
-  }
   const char* DebugDescription() const override {
-    return "A variables list, eg: a, b, c";
+    return "A list of zero or more variables, eg: a, b, c";
   }
 };
 
 // A code block is all valid code surrounded by {}.
 class CodeBlock : public ExpandableGrammarPiece<CodeBlock> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::CODE_BLOCK;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::CODE_BLOCK;
+
   const char* DebugDescription() const override {
     return "A code block, eg: {RETURN \"foobar\";}";
   }
 };
 
-// A StatementList is all valid code, or empty.
+// A StatementList is all valid code, or empty. Its children are the
+// statements.
 class StatementList : public ExpandableGrammarPiece<StatementList> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::STATEMENT_LIST;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::STATEMENT_LIST;
+
   const char* DebugDescription() const override {
     return "A list of zero or more statements, eg: foo = \"bar\"; return foo;";
   }
@@ -117,10 +111,8 @@ class StatementList : public ExpandableGrammarPiece<StatementList> {
 // a while loop, an if/else statement, a return statement.
 class Statement : public ExpandableGrammarPiece<Statement> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::STATEMENT;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::STATEMENT;
+
   const char* DebugDescription() const override {
     return "A valid statement, eg: foo = CONCAT(\"bar\", \"baz\");";
   }
@@ -129,10 +121,8 @@ class Statement : public ExpandableGrammarPiece<Statement> {
 // Assigns either a global or local variable to an RValue.
 class VariableAssignment : public ExpandableGrammarPiece<VariableAssignment> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::VARIABLE_ASSIGNMENT;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::VARIABLE_ASSIGNMENT;
+
   const char* DebugDescription() const override {
     return "A variable assignment, eg: foo = \"bar\"";
   }
@@ -141,10 +131,8 @@ class VariableAssignment : public ExpandableGrammarPiece<VariableAssignment> {
 // Declares a variable as global for the scope.
 class GlobalDeclaration : public ExpandableGrammarPiece<GlobalDeclaration> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::GLOBAL_DECLARATION;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::GLOBAL_DECLARATION;
+
   const char* DebugDescription() const override {
     return "A global declaration, eg: GLOBAL foo";
   }
@@ -153,10 +141,8 @@ class GlobalDeclaration : public ExpandableGrammarPiece<GlobalDeclaration> {
 // Calls a function.
 class FunctionCall : public ExpandableGrammarPiece<FunctionCall> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::FUNCTION_CALL;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::FUNCTION_CALL;
+
   const char* DebugDescription() const override {
     return "A function or builtin call, eg: PRINT(\"foobar\")";
   }
@@ -166,10 +152,8 @@ class FunctionCall : public ExpandableGrammarPiece<FunctionCall> {
 class ConditionalEvaluation
       : public ExpandableGrammarPiece<ConditionalEvaluation> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::CONDITIONAL_EVALUATOR;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::CONDITIONAL_EVALUATOR;
+
   const char* DebugDescription() const override {
     return "A conditional evaluator, eg: [\"TRUE\"]";
   }
@@ -178,10 +162,8 @@ class ConditionalEvaluation
 // Can be empty, or an ELSE{}, or an ELSE IF [] {}
 class ElseStatement : public ExpandableGrammarPiece<ElseStatement> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::ELSE_STATEMENT;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::ELSE_STATEMENT;
+
   const char* DebugDescription() const override {
     return "An else statement, eg: ELIF [\"TRUE\"] {}";
   }
@@ -191,10 +173,8 @@ class ElseStatement : public ExpandableGrammarPiece<ElseStatement> {
 // a variable, or a function call.
 class RValue : public ExpandableGrammarPiece<RValue> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::RVALUE;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::RVALUE;
+
   const char* DebugDescription() const override {
     return "An RValue- either a string, a variable, or a function call. eg: "
            "\"TRUE\"";
@@ -202,31 +182,187 @@ class RValue : public ExpandableGrammarPiece<RValue> {
 };
 
 // An RValue list is either empty, contains one RValue, or multiple RValues
-// separated by ,
+// separated by ,. The RValues are its children.
 class RValueList : public ExpandableGrammarPiece<RValueList> {
  public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::RVALUE_LIST;
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::RVALUE_LIST;
+
   const char* DebugDescription() const override {
     return "A list of zero or more RValues- strings, variables, and function "
            "calls. eg: \"TRUE\", EQUAL(\"1\", \"2\"), foo(\"BAR\")";
   }
 };
 
-class RValueListExpansion : public ExpandableGrammarPiece<RValueListExpansion> {
- public:
-  Descendents GetDescendents() const override;
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::RVALUE_LIST_EXPANSION;
+constexpr size_t kNumTokenLabels = static_cast<size_t>(GrammarLabel::MODULE);
+constexpr size_t kNumGrammarLabels =
+    static_cast<size_t>(GrammarLabel::RVALUE_LIST_EXPANSION) + 1;
+
+// One way an expandable grammar piece expands, into children with these
+// labels.
+struct Production {
+  static constexpr size_t kMaxChildren = 5;
+
+  GrammarLabel piece;
+  uint8_t num_children;
+  GrammarLabel children[kMaxChildren];
+};
+
+// The whole grammar. An empty production is what a piece expands to when
+// none of its others start with the next token.
+inline constexpr Production kProductions[] = {
+  {GrammarLabel::MODULE, 1, {GrammarLabel::END_OF_FILE}},
+  {GrammarLabel::MODULE, 2, {GrammarLabel::FUNCTION_DEFINITION, GrammarLabel::MODULE}},
+
+  {GrammarLabel::FUNCTION_DEFINITION, 5,
+   {GrammarLabel::FUNCTION_NAME, GrammarLabel::OPEN_FUNCTION_CALL, GrammarLabel::VARIABLES_LIST,
+    GrammarLabel::CLOSE_FUNCTION_CALL, GrammarLabel::CODE_BLOCK}},
+
+  {GrammarLabel::VARIABLES_LIST, 2,
+   {GrammarLabel::VARIABLE, GrammarLabel::VARIABLES_LIST_EXPANSION}},
+  {GrammarLabel::VARIABLES_LIST, 0, {}},
+
+  {GrammarLabel::VARIABLES_LIST_EXPANSION, 3,
+   {GrammarLabel::ARGUMENT_LIST_SEPARATOR, GrammarLabel::VARIABLE,
+    GrammarLabel::VARIABLES_LIST_EXPANSION}},
+  {GrammarLabel::VARIABLES_LIST_EXPANSION, 0, {}},
+
+  {GrammarLabel::CODE_BLOCK, 3,
+   {GrammarLabel::OPEN_CODE_BLOCK, GrammarLabel::STATEMENT_LIST, GrammarLabel::CLOSE_CODE_BLOCK}},
+
+  {GrammarLabel::STATEMENT_LIST, 2, {GrammarLabel::STATEMENT, GrammarLabel::STATEMENT_LIST}},
+  {GrammarLabel::STATEMENT_LIST, 0, {}},
+
+  {GrammarLabel::STATEMENT, 2, {GrammarLabel::VARIABLE_ASSIGNMENT, GrammarLabel::END_STATEMENT}},
+  {GrammarLabel::STATEMENT, 2, {GrammarLabel::GLOBAL_DECLARATION, GrammarLabel::END_STATEMENT}},
+  {GrammarLabel::STATEMENT, 2, {GrammarLabel::FUNCTION_CALL, GrammarLabel::END_STATEMENT}},
+  {GrammarLabel::STATEMENT, 3,
+   {GrammarLabel::KEYWORD_WHILE, GrammarLabel::CONDITIONAL_EVALUATOR, GrammarLabel::CODE_BLOCK}},
+  {GrammarLabel::STATEMENT, 4,
+   {GrammarLabel::KEYWORD_IF, GrammarLabel::CONDITIONAL_EVALUATOR, GrammarLabel::CODE_BLOCK,
+    GrammarLabel::ELSE_STATEMENT}},
+  {GrammarLabel::STATEMENT, 3,
+   {GrammarLabel::KEYWORD_RETURN, GrammarLabel::RVALUE, GrammarLabel::END_STATEMENT}},
+  {GrammarLabel::STATEMENT, 2, {GrammarLabel::KEYWORD_BREAK, GrammarLabel::END_STATEMENT}},
+
+  {GrammarLabel::VARIABLE_ASSIGNMENT, 3,
+   {GrammarLabel::VARIABLE, GrammarLabel::ASSIGNER, GrammarLabel::RVALUE}},
+
+  {GrammarLabel::GLOBAL_DECLARATION, 2, {GrammarLabel::KEYWORD_GLOBAL, GrammarLabel::VARIABLE}},
+
+  {GrammarLabel::FUNCTION_CALL, 4,
+   {GrammarLabel::FUNCTION_NAME, GrammarLabel::OPEN_FUNCTION_CALL, GrammarLabel::RVALUE_LIST,
+    GrammarLabel::CLOSE_FUNCTION_CALL}},
+  {GrammarLabel::FUNCTION_CALL, 4,
+   {GrammarLabel::BUILTIN, GrammarLabel::OPEN_FUNCTION_CALL, GrammarLabel::RVALUE_LIST,
+    GrammarLabel::CLOSE_FUNCTION_CALL}},
+
+  {GrammarLabel::CONDITIONAL_EVALUATOR, 3,
+   {GrammarLabel::OPEN_CONDITIONAL_BLOCK, GrammarLabel::RVALUE,
+    GrammarLabel::CLOSE_CONDITIONAL_BLOCK}},
+
+  {GrammarLabel::ELSE_STATEMENT, 2, {GrammarLabel::KEYWORD_ELSE, GrammarLabel::CODE_BLOCK}},
+  {GrammarLabel::ELSE_STATEMENT, 4,
+   {GrammarLabel::KEYWORD_ELIF, GrammarLabel::CONDITIONAL_EVALUATOR, GrammarLabel::CODE_BLOCK,
+    GrammarLabel::ELSE_STATEMENT}},
+  {GrammarLabel::ELSE_STATEMENT, 0, {}},
+
+  {GrammarLabel::RVALUE, 1, {GrammarLabel::QUOTED_STRING}},
+  {GrammarLabel::RVALUE, 1, {GrammarLabel::VARIABLE}},
+  {GrammarLabel::RVALUE, 1, {GrammarLabel::FUNCTION_CALL}},
+
+  {GrammarLabel::RVALUE_LIST, 2, {GrammarLabel::RVALUE, GrammarLabel::RVALUE_LIST_EXPANSION}},
+  {GrammarLabel::RVALUE_LIST, 0, {}},
+
+  {GrammarLabel::RVALUE_LIST_EXPANSION, 3,
+   {GrammarLabel::ARGUMENT_LIST_SEPARATOR, GrammarLabel::RVALUE,
+    GrammarLabel::RVALUE_LIST_EXPANSION}},
+  {GrammarLabel::RVALUE_LIST_EXPANSION, 0, {}},
+};
+
+// Lists are right-recursive above, but the parser gives each list a single
+// node whose children are its items in order, so long lists aren't deep
+// trees. Separators and the end of file aren't kept.
+constexpr bool IsList(GrammarLabel label) {
+  return label == GrammarLabel::MODULE || label == GrammarLabel::STATEMENT_LIST ||
+         label == GrammarLabel::VARIABLES_LIST || label == GrammarLabel::RVALUE_LIST;
+}
+
+// Whether a child with this label carries on the list, rather than being one
+// of its items.
+constexpr bool ContinuesList(GrammarLabel list, GrammarLabel child) {
+  return child == list ||
+         (list == GrammarLabel::VARIABLES_LIST &&
+          child == GrammarLabel::VARIABLES_LIST_EXPANSION) ||
+         (list == GrammarLabel::RVALUE_LIST && child == GrammarLabel::RVALUE_LIST_EXPANSION);
+}
+
+// Whether some expansion of piece has child at index.
+constexpr bool CanHaveChild(GrammarLabel piece, size_t index, GrammarLabel child) {
+  for (const Production& production : kProductions) {
+    if (production.piece == piece && index < production.num_children &&
+        production.children[index] == child) {
+      return true;
+    }
   }
-  const char* DebugDescription() const override {
-    return "A list of RValues- strings, variables, and function calls. eg: "
-           "\"TRUE\", EQUAL(\"1\", \"2\"), foo(\"BAR\")";
+  return false;
+}
+
+// Whether every expansion of piece with a child at index has one of
+// Children's labels there.
+template <typename... Children>
+constexpr bool ChildIsOneOf(GrammarLabel piece, size_t index) {
+  for (const Production& production : kProductions) {
+    if (production.piece == piece && index < production.num_children &&
+        ((production.children[index] != Children::kLabel) && ...)) {
+      return false;
+    }
   }
+  return true;
+}
+
+// Returns piece's child at index as a Child, which it must be. Fails to
+// compile if no expansion of Piece has a Child there.
+template <typename Child, size_t index, typename Piece>
+const Child& GetChild(const Piece& piece) {
+  static_assert(CanHaveChild(Piece::kLabel, index, Child::kLabel),
+                "The grammar never puts this child here");
+  return PieceCast<Child>(*piece.GetChildren().at(index));
+}
+
+// Combines lambdas into one visitor for VisitChild.
+template <typename... Lambdas>
+struct Visitor : Lambdas... {
+  using Lambdas::operator()...;
 };
 
+template <typename Child, typename... Rest, typename PieceVisitor>
+decltype(auto) VisitAs(const GrammarPiece& gp, PieceVisitor& visitor) {
+  if constexpr (sizeof...(Rest) == 0) {
+    return visitor(PieceCast<Child>(gp));
+  } else {
+    if (gp.GetLabel() == Child::kLabel) {
+      return visitor(static_cast<const Child&>(gp));
+    }
+    return VisitAs<Rest...>(gp, visitor);
+  }
+}
+
+// Calls visitor with piece's child at index, as whichever of Children it is.
+// Fails to compile unless Children covers every label the grammar allows
+// there, and visitor takes each of them.
+template <size_t index, typename... Children, typename Piece, typename PieceVisitor>
+decltype(auto) VisitChild(const Piece& piece, PieceVisitor&& visitor) {
+  static_assert(ChildIsOneOf<Children...>(Piece::kLabel, index),
+                "The grammar allows children this doesn't visit");
+  static_assert((std::is_invocable_v<PieceVisitor&, const Children&> && ...),
+                "The visitor doesn't take every child");
+  return VisitAs<Children...>(*piece.GetChildren().at(index), visitor);
+}
+
+// Returns a new, empty piece of any label, allocated from arena. Null for the
+// expansions of lists, which never get nodes of their own.
+GrammarPiece* CreateGrammarPiece(GrammarLabel label, AstArena& arena);
+
 }  // namespace pbc
 
 #endif  // #ifndef POIBOIC_GRAMMAR_H_
@@ -19,9 +19,12 @@ limitations under the License.
 #ifndef POIBOIC_GRAMMAR_PIECE_H_
 #define POIBOIC_GRAMMAR_PIECE_H_
 
-#include <memory>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <string>
-#include <vector>
+
+#include "ast_arena.h"
 
 namespace pbc {
 
@@ -66,29 +69,44 @@ enum class GrammarLabel {
   RVALUE_LIST_EXPANSION,
 };
 
-class GrammarPiece {
+class GrammarPiece;
+
+// A piece's children, which sit together in its tree's arena.
+class Children {
  public:
-  using Children = std::vector<std::unique_ptr<GrammarPiece>>;
-  using Descendents = std::vector<Children>;
+  Children() = default;
+  Children(GrammarPiece* const* pieces, size_t size) : pieces_(pieces), size_(size) {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  GrammarPiece* operator[](size_t i) const { return pieces_[i]; }
+  GrammarPiece* at(size_t i) const {
+    assert(i < size_);
+    return pieces_[i];
+  }
+  GrammarPiece* front() const { return at(0); }
+  GrammarPiece* back() const { return at(size_ - 1); }
+  GrammarPiece* const* begin() const { return pieces_; }
+  GrammarPiece* const* end() const { return pieces_ + size_; }
+
+ private:
+  GrammarPiece* const* pieces_ = nullptr;
+  uint32_t size_ = 0;
+};
 
+// Pieces are allocated from an AstArena and never destroyed on their own, so
+// everything they point to is in the arena too. Every class of piece has its
+// label as a static kLabel.
+class GrammarPiece {
+ public:
   virtual ~GrammarPiece() {}
-  GrammarPiece() = default;
-  GrammarPiece(const GrammarPiece& other) {
-    other.CloneGPBase(this);
-  }
-  GrammarPiece& operator=(const GrammarPiece& other) {
-    other.CloneGPBase(this);
-    return *this;
-  }
+  explicit GrammarPiece(GrammarLabel label) : label_(label) {}
+  GrammarPiece(const GrammarPiece&) = delete;
+  GrammarPiece& operator=(const GrammarPiece&) = delete;
   GrammarPiece(GrammarPiece&& other) = default;
   GrammarPiece& operator=(GrammarPiece&& other) = default;
 
-  virtual std::vector<std::vector<std::unique_ptr<GrammarPiece>>>
-  GetDescendents() const = 0;
-
-  virtual std::unique_ptr<GrammarPiece> Clone() const = 0;
-
-  virtual GrammarLabel GetLabel() const = 0;
+  GrammarLabel GetLabel() const { return label_; }
 
   bool IsToken() const {
     return GetLabel() < GrammarLabel::MODULE;
@@ -101,41 +119,34 @@ class GrammarPiece {
 
   virtual const char* DebugDescription() const = 0;
 
-  const std::vector<std::unique_ptr<GrammarPiece>>& GetChildren() const {
+  const Children& GetChildren() const {
     return children_;
   }
 
-  void MoveIntoChildren(
-    std::vector<std::unique_ptr<GrammarPiece>>& new_children) {
-    using ChildT = std::vector<std::unique_ptr<GrammarPiece>>::iterator;
-    children_.insert(
-        children_.end(),
-        std::move_iterator<ChildT>(new_children.begin()),
-        std::move_iterator<ChildT>(new_children.end()));
-    new_children.clear();
-  }
+  // The children must be in the same arena as this.
+  void SetChildren(Children children) { children_ = children; }
 
   size_t line_number() const { return line_number_; }
   void set_line_number(size_t line_num) { line_number_ = line_num; }
 
-  const std::string& file_name() const { return file_name_; }
-  void set_file_name(std::string fname) { file_name_ = std::move(fname); }
+  const std::string& file_name() const { return GetInternedFileName(file_id_); }
+  // An id from InternFileName.
+  void set_file_id(uint32_t file_id) { file_id_ = file_id; }
 
  protected:
-  void CloneGPBase(GrammarPiece* new_gp) const {
-    new_gp->line_number_ = line_number_;
-    new_gp->file_name_ = file_name_;
-    new_gp->children_.clear();
-    for (const auto& child : children_) {
-      new_gp->children_.push_back(child->Clone());
-    }
-  }
-
-  size_t line_number_ = 0;
-  std::string file_name_;
-  std::vector<std::unique_ptr<GrammarPiece>> children_;
+  GrammarLabel label_;
+  Children children_;
+  uint32_t line_number_ = 0;
+  uint32_t file_id_ = 0;
 };
 
+// Downcasts gp to the class for its label, which it must have.
+template <typename Piece>
+const Piece& PieceCast(const GrammarPiece& gp) {
+  assert(gp.GetLabel() == Piece::kLabel);
+  return static_cast<const Piece&>(gp);
+}
+
 }  // namespace pbc
 
 #endif  // #ifndef POIBOIC_GRAMMAR_PIECE_H_
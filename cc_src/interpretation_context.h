@@ -20,7 +20,10 @@ limitations under the License.
 #include <unordered_map>
 #include <unordered_set>
 
+#include "builtins.h"
 #include "function.h"
+#include "profile.h"
+#include "symbol_table.h"
 
 namespace pbc {
 
@@ -28,9 +31,18 @@ namespace pbc {
 struct CompilationContext {
   const std::unordered_map<std::string, const Function*>* fns{};
   std::unordered_set<std::string>* all_global_variables{};
-  std::unordered_set<std::string> curr_global_variables;
-  std::unordered_set<std::string> curr_local_variables;
+  const BuiltinRegistry* builtins{};
+  // The variables defined where analysis has got to.
+  ScopedSymbolTable* symbols{};
+  // Local variables stored as size_t rather than PBString.
+  const std::unordered_set<std::string>* size_variables{};
+  // Arguments which are reassigned, and so accessed through a pointer.
+  const std::unordered_set<std::string>* reassigned_arguments{};
   bool is_in_loop = false;
+  // Globals belong to whichever context calls in, as in shared objects.
+  bool globals_in_context = false;
+  // Set when instrumenting or optimizing with a profile.
+  FunctionProfile* profile{};
 };
 
 }  // namespace pbc
@@ -0,0 +1,46 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace pbc {
+
+void ParallelFor(size_t num_items, int num_workers,
+                 const std::function<void(size_t index, int worker)>& fn) {
+  num_workers = std::max(1, static_cast<int>(std::min<size_t>(num_workers, num_items)));
+  std::atomic<size_t> next_index = 0;
+  auto work = [&](int worker) {
+    for (size_t i = next_index++; i < num_items; i = next_index++) {
+      fn(i, worker);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_workers - 1);
+  for (int worker = 1; worker < num_workers; ++worker) {
+    threads.emplace_back(work, worker);
+  }
+  work(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace pbc
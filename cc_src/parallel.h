@@ -0,0 +1,35 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef POIBOIC_PARALLEL_H_
+#define POIBOIC_PARALLEL_H_
+
+#include <cstddef>
+#include <functional>
+
+namespace pbc {
+
+// Calls fn(index, worker) once for every index in [0, num_items), spread over
+// up to num_workers threads. worker is in [0, num_workers) and no two calls
+// with the same worker run at once, so it can pick out per thread state.
+// Returns once every call has finished. With one worker everything runs on
+// the calling thread, in order.
+void ParallelFor(size_t num_items, int num_workers,
+                 const std::function<void(size_t index, int worker)>& fn);
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_PARALLEL_H_
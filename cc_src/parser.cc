@@ -16,79 +16,219 @@ limitations under the License.
 
 #include "parser.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <unordered_map>
+
 namespace pbc {
 namespace {
 
-std::string ErrorString(const GrammarPiece& gp, const TokenPiece& token) {
-  return "Line " + std::to_string(token.line_number() + 1) +
+std::string ErrorString(const GrammarPiece& gp, const Token& token, std::string_view code) {
+  return "Line " + std::to_string(token.line + 1) +
          ": Parsing error.\nExpected: " + gp.DebugDescription() +
-         "\nGot: " + token.GetContent();
+         "\nGot: " + std::string(token.Text(code));
 }
 
-bool Expand(const GrammarPiece& gp, const TokenPiece& token,
-            std::vector<std::unique_ptr<GrammarPiece>>& expansion) {
-  expansion.clear();
-  if (gp.GetLabel() == token.GetLabel()) {
-    expansion.push_back(token.Clone());
-    return true;
-  } else if (gp.IsToken()) {
-    return false;
+// For each expandable piece and next token, the production to expand by,
+// from the FIRST sets of the grammar.
+struct ParseTable {
+  static constexpr uint8_t kNoProduction = 0xff;
+
+  uint8_t production[kNumGrammarLabels - kNumTokenLabels][kNumTokenLabels];
+
+  const Production* Find(GrammarLabel piece, GrammarLabel token) const {
+    const uint8_t index = production[static_cast<size_t>(piece) - kNumTokenLabels]
+                                    [static_cast<size_t>(token)];
+    return index == kNoProduction ? nullptr : &kProductions[index];
+  }
+};
+
+// Fails to compile if two productions of a piece start with the same token.
+constexpr ParseTable BuildParseTable() {
+  static_assert(kNumTokenLabels <= 32);
+  static_assert(std::size(kProductions) < ParseTable::kNoProduction);
+  // The tokens each piece can start with, as bits, and whether it can be
+  // empty. Grown until nothing changes.
+  uint32_t first[kNumGrammarLabels] = {};
+  bool nullable[kNumGrammarLabels] = {};
+  for (size_t token = 0; token < kNumTokenLabels; ++token) {
+    first[token] = uint32_t{1} << token;
+  }
+  auto production_first = [&](const Production& production, bool& is_nullable) {
+    uint32_t tokens = 0;
+    is_nullable = true;
+    for (size_t i = 0; i < production.num_children && is_nullable; ++i) {
+      const size_t child = static_cast<size_t>(production.children[i]);
+      tokens |= first[child];
+      is_nullable = nullable[child];
+    }
+    return tokens;
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (const Production& production : kProductions) {
+      const size_t piece = static_cast<size_t>(production.piece);
+      bool is_nullable;
+      const uint32_t tokens = production_first(production, is_nullable);
+      if ((first[piece] | tokens) != first[piece] || (is_nullable && !nullable[piece])) {
+        first[piece] |= tokens;
+        nullable[piece] = nullable[piece] || is_nullable;
+        changed = true;
+      }
+    }
+  }
+
+  ParseTable table;
+  for (auto& row : table.production) {
+    for (uint8_t& index : row) {
+      index = ParseTable::kNoProduction;
+    }
   }
-  bool allow_empty_expansion = false;
-  GrammarPiece::Descendents descendents = gp.GetDescendents();
-  for (auto& descendent_list : descendents) {
-    if (descendent_list.empty()) {
-      allow_empty_expansion = true;
-    } else {
-      std::vector<std::unique_ptr<GrammarPiece>> placeholder;
-      if (Expand(*descendent_list.front(), token, placeholder)) {
-        assert(expansion.empty());  // Should not have ambiguous grammar.
-        expansion = std::move(descendent_list);
+  for (size_t i = 0; i < std::size(kProductions); ++i) {
+    bool is_nullable;
+    const uint32_t tokens = production_first(kProductions[i], is_nullable);
+    auto& row = table.production[static_cast<size_t>(kProductions[i].piece) - kNumTokenLabels];
+    for (size_t token = 0; token < kNumTokenLabels; ++token) {
+      if (tokens & (uint32_t{1} << token)) {
+        if (row[token] != ParseTable::kNoProduction) {
+          throw "The grammar is ambiguous";
+        }
+        row[token] = i;
       }
     }
   }
-  for (auto& piece : expansion) {
-    piece->set_line_number(token.line_number());
-    piece->set_file_name(token.file_name());
+  // Empty productions take whatever no other production starts with.
+  for (size_t i = 0; i < std::size(kProductions); ++i) {
+    bool is_nullable;
+    production_first(kProductions[i], is_nullable);
+    if (!is_nullable) {
+      continue;
+    }
+    auto& row = table.production[static_cast<size_t>(kProductions[i].piece) - kNumTokenLabels];
+    for (uint8_t& index : row) {
+      if (index == ParseTable::kNoProduction) {
+        index = i;
+      }
+    }
   }
-  return allow_empty_expansion || !expansion.empty();
+  return table;
 }
+
+constexpr ParseTable kParseTable = BuildParseTable();
+
+// A piece waiting to be parsed.
+struct Pending {
+  GrammarLabel label;
+  // Null for the tokens lists don't keep.
+  GrammarPiece* piece;
+  // Whether this carries on the list piece is, which is already started.
+  bool continues_list;
+};
+
 }  // namespace
 
-ErrorCode ParseTokens(std::vector<std::unique_ptr<TokenPiece>>& tokens,
-                      Module& root) {
+ErrorCode ParseTokens(const std::vector<Token>& tokens, std::string_view code,
+                      const std::string& file_name, Module& root) {
   assert(tokens.size() > 0);
   root = Module();
+  AstArena& arena = root.arena();
+  const uint32_t file_id = InternFileName(file_name);
   root.set_line_number(0);
-  root.set_file_name(tokens.front()->file_name());
-  std::vector<GrammarPiece*> current_program;
-  current_program.emplace_back(&root);
+  root.set_file_id(file_id);
+  // The pieces still to be parsed, with the next one on top.
+  std::vector<Pending> stack;
+  stack.push_back({GrammarLabel::MODULE, &root, false});
+  // The items of the lists being parsed, innermost list last, and where each
+  // list's items start.
+  std::vector<GrammarPiece*> list_items;
+  std::vector<size_t> list_starts;
+  // Symbols already interned for this file, to save going to the shared
+  // table for every variable.
+  std::unordered_map<std::string_view, Symbol> symbols;
   size_t token_index = 0;
-  while (current_program.size() > 0) {
-    auto& gp = *current_program.front();
-    auto& token = *tokens.at(token_index);
-    std::vector<std::unique_ptr<GrammarPiece>> expansion;
-    if (!Expand(gp, token, expansion)) {
-      return ErrorCode::Failure(ErrorString(gp, token));
-    }
-    if (gp.IsToken()) {
-      TokenPiece& program_front = reinterpret_cast<TokenPiece&>(*current_program.front());
-      token.CopyTokenTo(&program_front);
+  while (!stack.empty()) {
+    const Pending pending = stack.back();
+    stack.pop_back();
+    const Token& token = tokens.at(token_index);
+    if (pending.label < GrammarLabel::MODULE) {
+      GrammarPiece* gp = pending.piece;
+      if (pending.label != token.label) {
+        if (gp == nullptr) {
+          gp = CreateGrammarPiece(pending.label, arena);
+        }
+        return ErrorCode::Failure(ErrorString(*gp, token, code));
+      }
+      if (gp != nullptr) {
+        if (HasVariableContent(token.label)) {
+          static_cast<ContentTokenPiece&>(*gp).set_content(arena.CopyString(token.Text(code)));
+        }
+        if (token.label == GrammarLabel::VARIABLE) {
+          Variable& variable = static_cast<Variable&>(*gp);
+          const std::string_view name = variable.GetContent();
+          auto [it, inserted] = symbols.try_emplace(name);
+          if (inserted) {
+            it->second = InternSymbol(name);
+          }
+          variable.set_symbol(it->second);
+        }
+        gp->set_line_number(token.line);
+      }
       ++token_index;
-      current_program.erase(current_program.begin());
-    } else {
-      std::vector<GrammarPiece*> expansion_ptrs;
-      for (const auto& expanded_piece : expansion) {
-        expansion_ptrs.push_back(expanded_piece.get());
+      continue;
+    }
+    GrammarPiece& gp = *pending.piece;
+    const Production* production = kParseTable.Find(pending.label, token.label);
+    if (production == nullptr) {
+      return ErrorCode::Failure(ErrorString(gp, token, code));
+    }
+    const bool is_list = IsList(gp.GetLabel());
+    if (is_list && !pending.continues_list) {
+      list_starts.push_back(list_items.size());
+    }
+    GrammarPiece** children =
+        is_list ? nullptr : arena.NewArray<GrammarPiece*>(production->num_children);
+    Pending expansion[Production::kMaxChildren];
+    bool list_continues = false;
+    for (size_t i = 0; i < production->num_children; ++i) {
+      const GrammarLabel label = production->children[i];
+      if (is_list && ContinuesList(gp.GetLabel(), label)) {
+        expansion[i] = {label, &gp, true};
+        list_continues = true;
+        continue;
+      }
+      if (is_list && label < GrammarLabel::MODULE && !HasVariableContent(label)) {
+        expansion[i] = {label, nullptr, false};
+        continue;
       }
-      current_program.front()->MoveIntoChildren(expansion);
-      current_program.erase(current_program.begin());
-      current_program.insert(current_program.begin(), expansion_ptrs.begin(),
-                             expansion_ptrs.end());
+      GrammarPiece* child = CreateGrammarPiece(label, arena);
+      child->set_line_number(token.line);
+      child->set_file_id(file_id);
+      expansion[i] = {label, child, false};
+      if (is_list) {
+        list_items.push_back(child);
+      } else {
+        children[i] = child;
+      }
+    }
+    if (!is_list) {
+      gp.SetChildren(Children(children, production->num_children));
+    } else if (!list_continues) {
+      // The list ends here, and its items move into the arena.
+      const size_t start = list_starts.back();
+      list_starts.pop_back();
+      const size_t num_items = list_items.size() - start;
+      GrammarPiece** items = arena.NewArray<GrammarPiece*>(num_items);
+      std::copy(list_items.begin() + start, list_items.end(), items);
+      list_items.resize(start);
+      gp.SetChildren(Children(items, num_items));
+    }
+    // Pushed last to first, so the first child is parsed next.
+    for (size_t i = production->num_children; i > 0; --i) {
+      stack.push_back(expansion[i - 1]);
     }
   }
   assert(token_index == tokens.size());
-  tokens.clear();
   return ErrorCode::Success();
 }
 
@@ -17,7 +17,8 @@ limitations under the License.
 #ifndef POIBOIC_PARSER_H_
 #define POIBOIC_PARSER_H_
 
-#include <memory>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "error_code.h"
@@ -25,8 +26,9 @@ limitations under the License.
 #include "tokens.h"
 
 namespace pbc {
-ErrorCode ParseTokens(std::vector<std::unique_ptr<TokenPiece>>& tokens,
-                      Module& root);
+// Parses the tokens scanned from code, which came from the file file_name.
+ErrorCode ParseTokens(const std::vector<Token>& tokens, std::string_view code,
+                      const std::string& file_name, Module& root);
 }  // namespace pbc
 
 #endif  // #ifndef POIBOIC_PARSER_H_
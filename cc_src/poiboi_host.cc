@@ -0,0 +1,118 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "poiboi_host.h"
+
+#include <dlfcn.h>
+
+std::shared_ptr<const PoiBoiLibrary> PoiBoiLibrary::Open(const std::string& path,
+                                                         std::string& error) {
+  void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (handle == nullptr) {
+    error = dlerror();
+    return nullptr;
+  }
+  const auto get_module = reinterpret_cast<PoiBoiModuleFn>(
+      dlsym(handle, POIBOI_MODULE_SYMBOL));
+  if (get_module == nullptr) {
+    error = path + " is not a PoiBoi shared object.";
+    dlclose(handle);
+    return nullptr;
+  }
+  const PoiBoiModule& module = *get_module();
+  if (module.abi_version != POIBOI_MODULE_ABI_VERSION ||
+      module.pbstring_size != sizeof(PBString)) {
+    error = path + " was built against a different PoiBoi runtime.";
+    dlclose(handle);
+    return nullptr;
+  }
+  return std::shared_ptr<const PoiBoiLibrary>(new PoiBoiLibrary(handle, module));
+}
+
+PoiBoiLibrary::PoiBoiLibrary(void* handle, const PoiBoiModule& module)
+    : handle_(handle), module_(module) {
+  functions_.reserve(module.num_functions);
+  for (size_t i = 0; i < module.num_functions; ++i) {
+    functions_.emplace(module.functions[i].name, &module.functions[i]);
+  }
+}
+
+PoiBoiLibrary::~PoiBoiLibrary() {
+  dlclose(handle_);
+}
+
+const PoiBoiFunctionEntry* PoiBoiLibrary::Find(std::string_view name) const {
+  const auto it = functions_.find(name);
+  return it == functions_.end() ? nullptr : it->second;
+}
+
+bool PoiBoiLibrary::Call(std::string_view name, const PBString* args, size_t num_args,
+                         PBString& result) const {
+  const PoiBoiFunctionEntry* entry = Find(name);
+  if (entry == nullptr || entry->num_args != num_args) {
+    return false;
+  }
+  void* globals = module_.new_globals();
+  entry->call(globals, args, &result);
+  module_.delete_globals(globals);
+  return true;
+}
+
+PoiBoiContext::PoiBoiContext(std::shared_ptr<const PoiBoiLibrary> library)
+    : library_(std::move(library)), globals_(library_->module_.new_globals()) {}
+
+PoiBoiContext::~PoiBoiContext() {
+  library_->module_.delete_globals(globals_);
+}
+
+bool PoiBoiContext::Call(std::string_view name, const PBString* args, size_t num_args,
+                         PBString& result) {
+  const PoiBoiFunctionEntry* entry = library_->Find(name);
+  if (entry == nullptr || entry->num_args != num_args) {
+    return false;
+  }
+  entry->call(globals_, args, &result);
+  return true;
+}
+
+bool PoiBoiHost::Load(const std::string& path, std::string& error) {
+  std::shared_ptr<const PoiBoiLibrary> library = PoiBoiLibrary::Open(path, error);
+  if (library == nullptr) {
+    return false;
+  }
+  current_.store(std::move(library));
+  return true;
+}
+
+std::shared_ptr<const PoiBoiLibrary> PoiBoiHost::Current() const {
+  return current_.load();
+}
+
+std::unique_ptr<PoiBoiContext> PoiBoiHost::NewContext() const {
+  std::shared_ptr<const PoiBoiLibrary> library = current_.load();
+  if (library == nullptr) {
+    return nullptr;
+  }
+  return std::make_unique<PoiBoiContext>(std::move(library));
+}
+
+bool PoiBoiHost::Call(std::string_view name, const PBString* args, size_t num_args,
+                      PBString& result) const {
+  // Holding the library keeps it loaded for the whole call, whatever Load
+  // does meanwhile.
+  const std::shared_ptr<const PoiBoiLibrary> library = current_.load();
+  return library != nullptr && library->Call(name, args, num_args, result);
+}
@@ -0,0 +1,119 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Loads PoiBoi programs built with poiboic --shared into a running process,
+// calls their functions by name, and swaps in new versions of them while
+// calls are in flight.
+//
+// Build every version to a fresh path, or rename it into place: the dynamic
+// loader hands back the library it already has for a file it has open.
+// The runtime's reference counts aren't atomic, so threads calling in at the
+// same time mustn't share strings.
+
+#ifndef POIBOI_HOST_H_
+#define POIBOI_HOST_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "poiboi_module.h"
+#include "poiboi_string.h"
+
+// One loaded shared object, which is unloaded along with the last reference
+// to it.
+class PoiBoiLibrary {
+ public:
+  // Returns null and sets error on failure.
+  static std::shared_ptr<const PoiBoiLibrary> Open(const std::string& path,
+                                                   std::string& error);
+  PoiBoiLibrary(const PoiBoiLibrary&) = delete;
+  PoiBoiLibrary& operator=(const PoiBoiLibrary&) = delete;
+  ~PoiBoiLibrary();
+
+  // Returns null if there's no function called name.
+  const PoiBoiFunctionEntry* Find(std::string_view name) const;
+
+  // Calls the function called name on globals of the call's own, which start
+  // out empty and are gone once it returns. So any number of threads can call
+  // at once; for globals that last between calls, use a PoiBoiContext.
+  // Returns false if there's no such function taking num_args.
+  bool Call(std::string_view name, const PBString* args, size_t num_args,
+            PBString& result) const;
+
+ private:
+  friend class PoiBoiContext;
+
+  PoiBoiLibrary(void* handle, const PoiBoiModule& module);
+
+  void* handle_;
+  const PoiBoiModule& module_;
+  // Names point into the library.
+  std::unordered_map<std::string_view, const PoiBoiFunctionEntry*> functions_;
+};
+
+// One script's globals, so a process can run any number of independent
+// scripts. Calls on a context mustn't overlap, but different contexts can be
+// used on different threads. Keeps its library loaded.
+class PoiBoiContext {
+ public:
+  explicit PoiBoiContext(std::shared_ptr<const PoiBoiLibrary> library);
+  PoiBoiContext(const PoiBoiContext&) = delete;
+  PoiBoiContext& operator=(const PoiBoiContext&) = delete;
+  ~PoiBoiContext();
+
+  // Calls the function called name on this context's globals, moving its
+  // return value into result. Only a literal the result holds is copied, so
+  // the result stays valid once the context and its library are released.
+  // Returns false if there's no such function taking num_args.
+  bool Call(std::string_view name, const PBString* args, size_t num_args,
+            PBString& result);
+
+  const PoiBoiLibrary& library() const { return *library_; }
+
+ private:
+  std::shared_ptr<const PoiBoiLibrary> library_;
+  void* globals_;
+};
+
+// Holds the current version of a program.
+class PoiBoiHost {
+ public:
+  // Swaps in the program at path. Calls already running finish on the
+  // version they started on, which stays loaded until they have. On failure,
+  // the current version is kept.
+  bool Load(const std::string& path, std::string& error);
+
+  // Null until something has been loaded.
+  std::shared_ptr<const PoiBoiLibrary> Current() const;
+
+  // A context on the current version, which it keeps using after a new
+  // version is loaded. Null until something has been loaded.
+  std::unique_ptr<PoiBoiContext> NewContext() const;
+
+  // Calls the function called name in the current version, on globals of the
+  // call's own, as PoiBoiLibrary::Call does. Returns false if nothing is
+  // loaded, or it has no such function taking num_args.
+  bool Call(std::string_view name, const PBString* args, size_t num_args,
+            PBString& result) const;
+
+ private:
+  std::atomic<std::shared_ptr<const PoiBoiLibrary>> current_;
+};
+
+#endif  // #ifndef POIBOI_HOST_H_
@@ -0,0 +1,60 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// The table of entry points that a PoiBoi program built with poiboic --shared
+// exports, so hosts like poiboi_host.h can look its functions up by name.
+// This is the only thing a host relies on, so it stays stable across
+// compiler versions; POIBOI_MODULE_ABI_VERSION changes whenever it doesn't.
+
+#ifndef POIBOI_MODULE_H_
+#define POIBOI_MODULE_H_
+
+#include <cstddef>
+
+#ifndef POIBOI_EXECUTABLE_
+#include "poiboi_string.h"
+#endif
+
+#define POIBOI_MODULE_ABI_VERSION 3
+// The extern "C" function returning a shared object's PoiBoiModule.
+#define POIBOI_MODULE_SYMBOL "poiboi_module"
+// Shared objects are built with -fvisibility=hidden, exporting only this.
+#define POIBOI_MODULE_EXPORT __attribute__((visibility("default")))
+
+struct PoiBoiFunctionEntry {
+  const char* name;
+  size_t num_args;
+  // Calls the function on args[0], ..., args[num_args - 1], with globals
+  // from new_globals() below. Calls on the same globals mustn't overlap. The
+  // result holds nothing static, so it stays valid after the module unloads.
+  void (*call)(void* globals, const PBString* args, PBString* result);
+};
+
+struct PoiBoiModule {
+  unsigned abi_version;
+  // The host and the module must agree on the runtime's string layout.
+  size_t pbstring_size;
+  size_t num_functions;
+  // Sorted by name.
+  const PoiBoiFunctionEntry* functions;
+  // A fresh set of the program's global variables, all empty.
+  void* (*new_globals)();
+  void (*delete_globals)(void* globals);
+};
+
+typedef const PoiBoiModule* (*PoiBoiModuleFn)();
+
+#endif  // #ifndef POIBOI_MODULE_H_
@@ -14,6 +14,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 #include <cassert>
+#include <limits>
 #include <random>
 #include <string>
 
@@ -158,6 +159,42 @@ void HugeSubstringTest() {
     assert(expected == concat);
   }
 }
+void NumericStringTest() {
+  const PBString zero = PBString::SizeToString(0);
+  const PBString big = PBString::SizeToString(1234567);
+  assert(zero.type() == NUMERIC_STRING);
+  assert(big.type() == NUMERIC_STRING);
+  assert(zero.Length() == 1);
+  assert(big.Length() == 7);
+  assert(zero == PBString::NewStaticString("0"));
+  assert(PBString::NewStaticString("1234567") == big);
+  assert(big == PBString::SizeToString(1234567));
+  assert(!(big == PBString::SizeToString(1234568)));
+  assert(!(big == PBString::NewStaticString("01234567")));
+  assert(!zero);
+
+  size_t out;
+  assert(big.StringToSize(out));
+  assert(out == 1234567);
+  const PBString max = PBString::SizeToString(std::numeric_limits<size_t>::max());
+  assert(max.Length() == NumericStringMaxDigits());
+  assert(!max.StringToSize(out));
+
+  PBString expected = PBString::NewStaticString("x1234567y0");
+  PBString concat = Builtin_Concat(PBString::NewStaticString("x"), big);
+  concat = Builtin_Concat(concat, PBString::NewStaticString("y"));
+  concat = Builtin_Concat(concat, zero);
+  assert(concat == expected);
+  expected = PBString::NewStaticString("A long enough prefix to join: 1234567");
+  assert(Builtin_Concat(PBString::NewStaticString("A long enough prefix to join: "),
+                        big) == expected);
+
+  assert(Builtin_Substring(big, PBString::SizeToString(2),
+                           PBString::SizeToString(5)) ==
+         PBString::NewStaticString("345"));
+  assert(Builtin_Substring(big, zero, PBString()).type() == NUMERIC_STRING);
+  assert(Builtin_Strlen(Builtin_Strlen(big)) == PBString::NewStaticString("1"));
+}
 }  // namespace
 
 int main() {
@@ -168,5 +205,6 @@ int main() {
   StrLenTest();
   SubstringIndicesTest();
   HugeSubstringTest();
+  NumericStringTest();
   return 0;
 }
@@ -18,19 +18,17 @@ limitations under the License.
 // Don't need to include the .h file in a PoiBoi executable, everything will
 // be concatted into one file.
 #include "poiboi_string.h"
-#else
-// Always want to use assertions in a non-executable. In the executable it may
-// be triggered by compilation mode.
-#define POIBOI_INCLUDE_ASSERT_
 #endif
 
-#ifdef POIBOI_INCLUDE_ASSERT_
+// Assertions are on unless this is a release build: the release runtime
+// library, or an executable poiboic generates at -O3.
+#ifndef POIBOI_RELEASE_
 #define ASSERT(x) assert(x)
 #define CRASH_RETURN(x) assert(false); return x
 #else
 #define ASSERT(X)
 #define CRASH_RETURN(x) return x
-#endif  // #ifdef INCLUDE_ASSERT
+#endif  // #ifndef POIBOI_RELEASE_
 
 namespace {
 // TODO: The three functions below should be made thread safe.
@@ -49,7 +47,8 @@ char* NewRefCountedString(size_t num_chars, RefCountedString& s) {
 }
 
 // Decrements the reference counter. If it is 0, the string is freed.
-void CleanupRefCountedString(RefCountedString& str) {
+POIBOI_ALWAYS_INLINE
+inline void CleanupRefCountedString(RefCountedString& str) {
   ASSERT(*str.num_references_held > 0);
   --(*str.num_references_held);
   if (*str.num_references_held == 0) {
@@ -58,7 +57,8 @@ void CleanupRefCountedString(RefCountedString& str) {
 }
 
 // Copies in to out and increments the reference counter.
-RefCountedString CopyRefCountedString(const RefCountedString& in) {
+POIBOI_ALWAYS_INLINE
+inline RefCountedString CopyRefCountedString(const RefCountedString& in) {
   RefCountedString out;
   ASSERT(*in.num_references_held > 0);
   out = in;
@@ -66,6 +66,45 @@ RefCountedString CopyRefCountedString(const RefCountedString& in) {
   return out;
 }
 
+// Returns the number of decimal digits needed to write value.
+size_t NumDigits(size_t value) {
+  size_t num_digits = 1;
+  while (value >= 10) {
+    value /= 10;
+    ++num_digits;
+  }
+  return num_digits;
+}
+
+// Writes out the digits of a numeric string the first time they're needed.
+// Like the reference counting above, this is not thread safe.
+const char* RenderNumericString(const NumericString& ns) {
+  if (ns.num_digits_rendered == 0) {
+    size_t value = ns.value;
+    const size_t num_digits = NumDigits(value);
+    for (size_t i = num_digits; i > 0; --i) {
+      ns.digits[i - 1] = '0' + value % 10;
+      value /= 10;
+    }
+    ns.num_digits_rendered = num_digits;
+  }
+  return ns.digits;
+}
+
+POIBOI_ALWAYS_INLINE
+inline size_t NumericStringLength(const NumericString& ns) {
+  return ns.num_digits_rendered != 0 ? ns.num_digits_rendered
+                                     : NumDigits(ns.value);
+}
+
+SmallString NumericToSmallString(const NumericString& ns) {
+  SmallString ss;
+  const char* digits = RenderNumericString(ns);
+  ss.length = ns.num_digits_rendered;
+  memcpy(ss.string, digits, ss.length);
+  return ss;
+}
+
 // Copies a JoinPayload. Also
 JoinPayload CopyJoinPayload(
     const JoinType in_type, const JoinPayload& in_jp) {
@@ -102,7 +141,7 @@ StringPayload CopyStringPayload(const TypeOfString in_type,
     case JOIN_RESULT:
       out_sp.join_result = CopyJoinResult(in_sp.join_result);
       break;
-    case SMALL_STRING: case STATIC_STRING:
+    case SMALL_STRING: case STATIC_STRING: case NUMERIC_STRING:
       out_sp = in_sp;
       break;
   }
@@ -140,24 +179,40 @@ JoinPayload StringPayloadToJoinPayload(const StringPayload& sp,
     case REF_COUNTED_STRING:
       jp.ref_counted_string = CopyRefCountedString(sp.ref_counted_string);
       break;
+    case NUMERIC_STRING:
+      jp.small_string = NumericToSmallString(sp.numeric_string);
+      break;
     case JOIN_RESULT:
       CRASH_RETURN(jp);
   }
   return jp;
 }
 
+void CleanupJoinPayload(JoinType type, JoinPayload& jp) {
+  switch (type) {
+    case JOINED_STATIC_STRING: case JOINED_SMALL_STRING:
+      return;
+    case JOINED_REF_COUNTED_STRING:
+      CleanupRefCountedString(jp.ref_counted_string);
+      return;
+  }
+}
+
+// Only ref counted payloads hold anything to release; every other type returns
+// before the payload is read.
 void CleanupStringPayload(TypeOfString type, StringPayload& sp) {
-  if (type == REF_COUNTED_STRING) {
-    CleanupRefCountedString(sp.ref_counted_string);
-  } else if (type == JOIN_RESULT) {
-    // Cleanup any possible ref counted strings in the join result.
-    JoinResult& jr = sp.join_result;
-    if (jr.left_type == JOINED_REF_COUNTED_STRING) {
-      CleanupRefCountedString(jr.left_payload.ref_counted_string);
-    }
-    if (jr.right_type == JOINED_REF_COUNTED_STRING) {
-      CleanupRefCountedString(jr.right_payload.ref_counted_string);
-    }
+  switch (type) {
+    case STATIC_STRING: case SMALL_STRING: case NUMERIC_STRING:
+      return;
+    case REF_COUNTED_STRING:
+      CleanupRefCountedString(sp.ref_counted_string);
+      return;
+    case JOIN_RESULT:
+      // Cleanup any possible ref counted strings in the join result.
+      CleanupJoinPayload(sp.join_result.left_type, sp.join_result.left_payload);
+      CleanupJoinPayload(sp.join_result.right_type,
+                         sp.join_result.right_payload);
+      return;
   }
 }
 
@@ -169,7 +224,7 @@ JoinType TypeOfStringToJoinType(const TypeOfString t) {
       return JOINED_STATIC_STRING;
     case REF_COUNTED_STRING:
       return JOINED_REF_COUNTED_STRING;
-    case SMALL_STRING:
+    case SMALL_STRING: case NUMERIC_STRING:
       return JOINED_SMALL_STRING;
     case JOIN_RESULT:
       CRASH_RETURN(JOINED_STATIC_STRING);
@@ -198,13 +253,16 @@ size_t JoinPayloadLength(JoinType type, const JoinPayload& jp) {
       return jp.small_string.length;
   }
 }
-size_t LeftLength(const JoinResult& jp) {
+POIBOI_ALWAYS_INLINE
+inline size_t LeftLength(const JoinResult& jp) {
   return JoinPayloadLength(jp.left_type, jp.left_payload);
 }
-size_t RightLength(const JoinResult& jp) {
+POIBOI_ALWAYS_INLINE
+inline size_t RightLength(const JoinResult& jp) {
   return JoinPayloadLength(jp.right_type, jp.right_payload);
 }
-size_t JoinLength(const JoinResult& jp) {
+POIBOI_ALWAYS_INLINE
+inline size_t JoinLength(const JoinResult& jp) {
   return LeftLength(jp) + RightLength(jp);
 }
 const char* JoinPayloadRawString(JoinType type, const JoinPayload& jp) {
@@ -217,10 +275,12 @@ const char* JoinPayloadRawString(JoinType type, const JoinPayload& jp) {
       return jp.small_string.string;
   }
 }
-const char* LeftRawString(const JoinResult& jp) {
+POIBOI_ALWAYS_INLINE
+inline const char* LeftRawString(const JoinResult& jp) {
   return JoinPayloadRawString(jp.left_type, jp.left_payload);
 }
-const char* RightRawString(const JoinResult& jp) {
+POIBOI_ALWAYS_INLINE
+inline const char* RightRawString(const JoinResult& jp) {
   return JoinPayloadRawString(jp.right_type, jp.right_payload);
 }
 
@@ -369,28 +429,6 @@ StringPayload SubstringOfJoinResult(
   return out_payload;
 }
 
-const char* AllThreeDigitNumbers() {
-  char* nums = (char*)malloc(3 * 900 + 1);
-  for (int i = 100; i < 1000; ++i) {
-    int index = (i - 100) * 3;
-    nums[index + 2] = i % 10 + '0';
-    nums[index + 1] = (i / 10) % 10 + '0';
-    nums[index] = (i / 100) % 10 + '0';
-  }
-  return nums;
-}
-
-const char* SmallSizeToRawString(size_t size) {
-  static const char* all_three_digit_nums = AllThreeDigitNumbers();
-  ASSERT(size < 1000);
-  if (size < 10) {
-    return all_three_digit_nums + 3 * size + 2;
-  } else if (size < 100) {
-    return all_three_digit_nums + 3 * size + 1;
-  }
-  return  all_three_digit_nums + 3 * (size - 100);
-}
-
 // If we have more chars then this, we don't check if it parses to a number.
 constexpr size_t MaxSizeNumChars() {
   static_assert(sizeof(size_t) == 8 || sizeof(size_t) == 4 ||
@@ -451,7 +489,7 @@ PBString PBString::Substring(const PBString& string, size_t start_index,
   if (end_index > string_length) {
     end_index = string_length;
   }
-  if (start_index >= end_index) {
+  if (POIBOI_UNLIKELY(start_index >= end_index)) {
     return substr;
   }
   switch(string.type_) {
@@ -474,6 +512,17 @@ PBString PBString::Substring(const PBString& string, size_t start_index,
       DecrementPayloadLength(string_length - end_index, JOINED_SMALL_STRING,
                              substr.payload_);
       return substr;
+    case NUMERIC_STRING:
+      if (start_index == 0 && end_index == string_length) {
+        return string;
+      }
+      substr.type_ = SMALL_STRING;
+      substr.payload_.small_string =
+          NumericToSmallString(string.payload_.numeric_string);
+      PayloadShiftRight(start_index, JOINED_SMALL_STRING, substr.payload_);
+      DecrementPayloadLength(string_length - end_index, JOINED_SMALL_STRING,
+                             substr.payload_);
+      return substr;
     case JOIN_RESULT:
       substr.payload_ = SubstringOfJoinResult(
         string.payload_.join_result, start_index, end_index, substr.type_);
@@ -485,9 +534,9 @@ PBString PBString::Concat(const PBString& s1, const PBString& s2) {
   size_t length_s1 = s1.Length();
   size_t length_s2 = s2.Length();
   size_t result_length = length_s1 + length_s2;
-  if (length_s1 == 0) {
+  if (POIBOI_UNLIKELY(length_s1 == 0)) {
     return s2;
-  } else if (length_s2 == 0) {
+  } else if (POIBOI_UNLIKELY(length_s2 == 0)) {
     return s1;
   }
   PBString ret;
@@ -530,44 +579,41 @@ PBString PBString::Concat(const PBString& s1, const PBString& s2) {
 
 PBString PBString::SizeToString(size_t size) {
   PBString size_str;
-  if (size < 1000) {
-    size_str.type_ = STATIC_STRING;
-    size_str.payload_.static_string.string = SmallSizeToRawString(size);
-    if (size < 10) {
-      size_str.payload_.static_string.length = 1;
-    } else if (size < 100) {
-      size_str.payload_.static_string.length = 2;
-    } else {
-      size_str.payload_.static_string.length = 3;
-    }
-    return size_str;
-  }
-  char* write_to;
-
-  constexpr int kBufferSize = MaxSizeNumChars() + 1;
-
-  if (kBufferSize > SmallStringMaxLength()) {
-    size_str.type_ = REF_COUNTED_STRING;
-    write_to = NewRefCountedString(
-        kBufferSize, size_str.payload_.ref_counted_string);
-  } else {
-    size_str.type_ = SMALL_STRING;
-    write_to = size_str.payload_.small_string.string;
-  }
-  int result = snprintf(write_to, kBufferSize, "%zu", size);
-  if (result < kBufferSize && result >= 0) {
-    if (size_str.type() == REF_COUNTED_STRING) {
-      size_str.payload_.ref_counted_string.length = result;
-    } else {
-      ASSERT(size_str.type() == SMALL_STRING);
-      size_str.payload_.small_string.length = result;
-    }
-  } else {
-    CRASH_RETURN(size_str);
-  }
+  size_str.type_ = NUMERIC_STRING;
+  size_str.payload_.numeric_string.value = size;
+  size_str.payload_.numeric_string.num_digits_rendered = 0;
   return size_str;
 }
 
+PBString PBString::OwnedCopy(const PBString& string) {
+  const bool has_static_payload = string.type_ == STATIC_STRING ||
+      (string.type_ == JOIN_RESULT &&
+       (string.payload_.join_result.left_type == JOINED_STATIC_STRING ||
+        string.payload_.join_result.right_type == JOINED_STATIC_STRING));
+  if (!has_static_payload) {
+    return string;
+  }
+  const char* rs1;
+  const char* rs2;
+  size_t length1;
+  size_t length2;
+  string.GetRawStrings(rs1, rs2);
+  string.GetLengths(length1, length2);
+  const size_t length = length1 + length2;
+  PBString owned;
+  if (length <= SmallStringMaxLength()) {
+    owned.payload_.small_string.length = length;
+    WriteToString(rs1, length1, rs2, length2, nullptr, 0, nullptr, 0,
+                  owned.payload_.small_string.string);
+    return owned;
+  }
+  owned.type_ = REF_COUNTED_STRING;
+  char* write_to = NewRefCountedString(length + 1, owned.payload_.ref_counted_string);
+  owned.payload_.ref_counted_string.length = length;
+  WriteToString(rs1, length1, rs2, length2, nullptr, 0, nullptr, 0, write_to);
+  return owned;
+}
+
 PBString::~PBString() {
   CleanupStringPayload(type_, payload_);
 }
@@ -622,6 +668,8 @@ size_t PBString::Length() const {
       return payload_.small_string.length;
     case JOIN_RESULT:
       return JoinLength(payload_.join_result);
+    case NUMERIC_STRING:
+      return NumericStringLength(payload_.numeric_string);
   }
 }
 
@@ -633,6 +681,8 @@ const char* PBString::RawStr() const {
         return payload_.ref_counted_string.string;
       case SMALL_STRING:
         return payload_.small_string.string;
+      case NUMERIC_STRING:
+        return RenderNumericString(payload_.numeric_string);
       case JOIN_RESULT:
         CRASH_RETURN(nullptr);
     }
@@ -641,6 +691,7 @@ const char* PBString::RawStr() const {
 void PBString::GetRawStrings(const char*& rs1, const char*& rs2) const {
   switch (type_) {
     case STATIC_STRING: case REF_COUNTED_STRING: case SMALL_STRING:
+    case NUMERIC_STRING:
       rs1 = RawStr();
       rs2 = nullptr;
       break;
@@ -654,6 +705,7 @@ void PBString::GetRawStrings(const char*& rs1, const char*& rs2) const {
 void PBString::GetLengths(size_t& l1, size_t& l2) const {
   switch (type_) {
     case STATIC_STRING: case REF_COUNTED_STRING: case SMALL_STRING:
+    case NUMERIC_STRING:
       l1 = Length();
       l2 = 0;
       break;
@@ -685,6 +737,9 @@ size_t PBString::RightLen() const {
 }
 
 bool PBString::operator==(const PBString& other) const {
+  if (type_ == NUMERIC_STRING && other.type_ == NUMERIC_STRING) {
+    return payload_.numeric_string.value == other.payload_.numeric_string.value;
+  }
   const size_t length = Length();
   if (length != other.Length()) {
     return false;
@@ -704,15 +759,23 @@ bool PBString::operator==(const PBString& other) const {
 }
 
 PBString::operator bool() const {
+  if (type_ == NUMERIC_STRING) {
+    return false;
+  }
   return *this == PBString::True();
 }
 
 bool PBString::StringToSize(size_t& out) const {
   out = 0;
   size_t string_length = Length();
-  if (string_length >= MaxSizeNumChars() || string_length == 0) {
+  if (POIBOI_UNLIKELY(string_length >= MaxSizeNumChars() ||
+                      string_length == 0)) {
     return false;
   }
+  if (type_ == NUMERIC_STRING) {
+    out = payload_.numeric_string.value;
+    return true;
+  }
   constexpr int kBufferSize = MaxSizeNumChars() + 1;
   char join_buffer[kBufferSize];
   const char* raw_string;
@@ -756,14 +819,25 @@ PBString Builtin_Print(const PBString& s) {
   return s;
 }
 
-PBString Builtin_Substring(
-    const PBString& s, const PBString& start_str, const PBString& end_str) {
-  size_t start, end;
+size_t Builtin_SubstringStartIndex(const PBString& start_str) {
+  size_t start;
   if (!start_str.StringToSize(start)) {
     start = 0;
   }
+  return start;
+}
+
+size_t Builtin_SubstringEndIndex(const PBString& end_str) {
+  size_t end;
   if (!end_str.StringToSize(end)) {
-    end = s.Length();
+    // Substring clamps this to the string's length.
+    end = std::numeric_limits<size_t>::max();
   }
-  return PBString::Substring(s, start, end);
+  return end;
+}
+
+PBString Builtin_Substring(
+    const PBString& s, const PBString& start_str, const PBString& end_str) {
+  return PBString::Substring(s, Builtin_SubstringStartIndex(start_str),
+                             Builtin_SubstringEndIndex(end_str));
 }
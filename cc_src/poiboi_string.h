@@ -25,12 +25,26 @@ limitations under the License.
 #include <limits>
 #include <utility>
 
+// Release builds (poiboic -O3 or --release, and the release runtime library)
+// define POIBOI_RELEASE_, which forces the tiniest helpers inline and hints
+// which way the runtime's branches go.
+#ifdef POIBOI_RELEASE_
+#define POIBOI_ALWAYS_INLINE [[gnu::always_inline]]
+#define POIBOI_LIKELY(x) __builtin_expect(!!(x), 1)
+#define POIBOI_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define POIBOI_ALWAYS_INLINE
+#define POIBOI_LIKELY(x) (x)
+#define POIBOI_UNLIKELY(x) (x)
+#endif  // #ifdef POIBOI_RELEASE_
+
 // This represents all the possible string types (defined below).
 enum TypeOfString {
   STATIC_STRING = 0,
   REF_COUNTED_STRING = 1,
   SMALL_STRING = 2,
   JOIN_RESULT = 3,
+  NUMERIC_STRING = 4,
 };
 
 // String is allocated statically. No cleanup needed.
@@ -65,6 +79,26 @@ struct SmallString {
   unsigned char length;
 };
 
+// The most decimal digits a size_t can have.
+inline constexpr size_t NumericStringMaxDigits() {
+  return std::numeric_limits<size_t>::digits10 + 1;
+}
+
+static_assert(NumericStringMaxDigits() <= SmallStringMaxLength(),
+              "Numeric strings are joined as small strings.");
+
+// String is the decimal representation of value. The digits are only written
+// out the first time somebody reads the raw string, so index arithmetic can
+// pass these around without formatting or parsing anything.
+struct NumericString {
+  size_t value;
+  // Not the last member: GCC treats a trailing array as possibly flexible, so
+  // writing digits would look like it could clobber the PBString's type.
+  mutable char digits[NumericStringMaxDigits()];
+  // 0 until the digits have been rendered.
+  mutable unsigned char num_digits_rendered;
+};
+
 
 // The payloads that can exist in a JoinResult. Everything except the JoinResult
 // itself.
@@ -89,12 +123,13 @@ struct JoinResult {
   enum JoinType right_type;
 };
 
-// A string is exactly one of the four types above.
+// A string is exactly one of the five types above.
 union StringPayload {
   struct StaticString static_string;
   struct RefCountedString ref_counted_string;
   struct JoinResult join_result;
   struct SmallString small_string;
+  struct NumericString numeric_string;
 };
 
 class PBString {
@@ -111,7 +146,12 @@ class PBString {
   static PBString Substring(const PBString& string, size_t start_index,
                             size_t end_index);
   static PBString Concat(const PBString& s1, const PBString& s2);
+  // Returns a NUMERIC_STRING; no digits are written until they're read.
   static PBString SizeToString(size_t size);
+  // A copy of string which doesn't point into static storage, so it can
+  // outlive the code that holds its literals, like an unloaded shared object.
+  // Only static payloads are copied.
+  static PBString OwnedCopy(const PBString& string);
 
   // Rule of 5- destructor, copy constructor, move constructor, copy assignment,
   // move assignment.
@@ -157,27 +197,32 @@ PBString Builtin_Equal(const PBString& s1, const PBString& s2);
 
 PBString Builtin_Print(const PBString& s);
 
+POIBOI_ALWAYS_INLINE
 inline PBString Builtin_Concat(const PBString& s1, const PBString& s2) {
   return PBString::Concat(s1, s2);
 }
 
+POIBOI_ALWAYS_INLINE
 inline PBString Builtin_Not(const PBString& s) {
   PBString string_true = PBString::True();
   return s == string_true ? PBString::False() : string_true;
 }
 
+POIBOI_ALWAYS_INLINE
 inline PBString Builtin_And(const PBString& s1, const PBString& s2) {
   PBString string_true = PBString::True();
   return s1 == string_true && s2 == string_true
          ? string_true : PBString::False();
 }
 
+POIBOI_ALWAYS_INLINE
 inline PBString Builtin_Or(const PBString& s1, const PBString& s2) {
   PBString string_true = PBString::True();
   return s1 == string_true || s2 == string_true
          ? string_true : PBString::False();
 }
 
+POIBOI_ALWAYS_INLINE
 inline PBString Builtin_Strlen(const PBString& s) {
   return PBString::SizeToString(s.Length());
 }
@@ -185,4 +230,26 @@ inline PBString Builtin_Strlen(const PBString& s) {
 PBString Builtin_Substring(
     const PBString& s, const PBString& start_str, const PBString& end_str);
 
+// The variants below are used when the compiler has proven that some values
+// are canonical non-negative integers, and keeps them as size_t instead.
+
+POIBOI_ALWAYS_INLINE
+inline size_t Builtin_StrlenAsSize(const PBString& s) {
+  return s.Length();
+}
+
+POIBOI_ALWAYS_INLINE
+inline PBString Builtin_Equal(size_t s1, size_t s2) {
+  return s1 == s2 ? PBString::True() : PBString::False();
+}
+
+// Interpret a string as SUBSTRING would for its start and end index.
+size_t Builtin_SubstringStartIndex(const PBString& start_str);
+size_t Builtin_SubstringEndIndex(const PBString& end_str);
+
+POIBOI_ALWAYS_INLINE
+inline PBString Builtin_Substring(const PBString& s, size_t start, size_t end) {
+  return PBString::Substring(s, start, end);
+}
+
 #endif  // #ifndef POIBOI_STRING_H_
@@ -14,23 +14,112 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <charconv>
+#include <chrono>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <streambuf>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "ast_cache.h"
+#include "code_emitter.h"
 #include "codegen.h"
+#include "parallel.h"
 #include "parser.h"
 #include "scanner.h"
+#include "source_file.h"
 #include "tokens.h"
+#include "vm.h"
+
+// Set by make.py to wherever it put the runtime library.
+#ifndef POIBOIC_RUNTIME_DIR
+#define POIBOIC_RUNTIME_DIR "runtime"
+#endif
 
 namespace pbc {
 namespace {
 
-bool Scan(const std::string& code,
-          std::vector<std::unique_ptr<TokenPiece>>& tokens) {
-  const ErrorCode ec = ScanTokens(code, tokens);
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Seconds spent on each stage of reading one input file.
+struct FrontEndTimes {
+  double open = 0;
+  double scan = 0;
+  double parse = 0;
+};
+
+// What became of reading one input file. Errors are kept to be reported in
+// argv order once every file is done.
+struct FrontEndResult {
+  // Kept open for the whole compile, as tokens point into it.
+  std::optional<SourceFile> source;
+  // poiboic's exit code if reading failed, with what to print in error.
+  int exit_code = 0;
+  std::string error;
+  FrontEndTimes times;
+};
+
+// Opens, scans and parses a file into module, or loads it from the cache if
+// cache_dir is set.
+FrontEndResult ReadModule(const std::string& file_name, const std::string& cache_dir,
+                          Module& module) {
+  FrontEndResult result;
+  auto start = std::chrono::steady_clock::now();
+  ErrorOr<SourceFile> source = SourceFile::Open(file_name);
+  result.times.open = SecondsSince(start);
+  if (source.IsFailure()) {
+    result.exit_code = 2;
+    result.error = "Compilation failed.\n" + source.ErrorMessage();
+    return result;
+  }
+  result.source = std::move(source.GetItem());
+  const std::string_view code = result.source->code();
+  std::string cache_key;
+  if (!cache_dir.empty()) {
+    cache_key = GetAstCacheKey(code);
+    if (LoadCachedModule(cache_dir, cache_key, file_name, module).IsSuccess()) {
+      return result;
+    }
+  }
+  start = std::chrono::steady_clock::now();
+  std::vector<Token> tokens;
+  const ErrorCode scan_ec = ScanTokens(code, tokens);
+  result.times.scan = SecondsSince(start);
+  if (scan_ec.IsFailure()) {
+    result.exit_code = 3;
+    result.error = "Compilation error.\n" + scan_ec.ErrorMessage() +
+                   "\nCompilation failed while scanning " + file_name;
+    return result;
+  }
+  start = std::chrono::steady_clock::now();
+  const ErrorCode parse_ec = ParseTokens(tokens, code, file_name, module);
+  result.times.parse = SecondsSince(start);
+  if (parse_ec.IsFailure()) {
+    result.exit_code = 4;
+    result.error = "Compilation error.\n" + parse_ec.ErrorMessage() +
+                   "\nCompilation failed while parsing " + file_name;
+    return result;
+  }
+  // The cache only saves time, so failing to update it isn't an error.
+  if (!cache_dir.empty()) {
+    StoreCachedModule(cache_dir, cache_key, module);
+  }
+  return result;
+}
+
+void PrintTime(const char* stage, double seconds) {
+  std::fprintf(stderr, "%-10s %8.3fs\n", stage, seconds);
+}
+
+bool Generate(const std::vector<Module>& modules, const CodegenOptions& options,
+              CodeEmitter& out) {
+  const ErrorCode ec = GenerateCode(modules, options, out);
   if (ec.IsFailure()) {
     std::cerr << "Compilation error.\n"
               << ec.ErrorMessage() << std::endl;
@@ -39,24 +128,148 @@ bool Scan(const std::string& code,
   return true;
 }
 
-bool Parse(std::vector<std::unique_ptr<TokenPiece>>& tokens,
-           Module& module) {
-  const ErrorCode ec = ParseTokens(tokens, module);
+struct CommandLine {
+  CodegenOptions options;
+  std::string cache_dir;
+  // Run the program on the VM instead of writing C++.
+  bool run = false;
+  // Print how long each stage of compilation took.
+  bool print_times = false;
+  // With --run, what follows "--" is passed to the program.
+  std::vector<std::string> program_args;
+  std::vector<std::string> file_names;
+};
+
+// Splits argv into flags, which start with "--" (or are -j or -O), and file
+// names.
+// Returns false on an unrecognized or malformed flag.
+bool ParseArgs(int argc, char** argv, CommandLine& command_line) {
+  CodegenOptions& options = command_line.options;
+  constexpr std::string_view kBuiltins = "--builtins=";
+  constexpr std::string_view kCacheDir = "--cache-dir=";
+  constexpr std::string_view kProfileGenerate = "--profile-generate=";
+  constexpr std::string_view kProfileUse = "--profile-use=";
+  constexpr std::string_view kRuntimeDir = "--runtime-dir=";
+  constexpr std::string_view kSplit = "--split=";
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "--") {
+      command_line.program_args.assign(argv + i + 1, argv + argc);
+      break;
+    } else if (arg.starts_with("-j")) {
+      // Either -jN or -j N.
+      std::string_view num_threads = arg.substr(2);
+      if (num_threads.empty() && i + 1 < argc) {
+        num_threads = argv[++i];
+      }
+      const auto result = std::from_chars(num_threads.data(),
+                                          num_threads.data() + num_threads.size(),
+                                          options.num_threads);
+      if (result.ec != std::errc() || result.ptr != num_threads.data() + num_threads.size() ||
+          options.num_threads < 1) {
+        std::cerr << "Expected a positive number of threads after -j" << std::endl;
+        return false;
+      }
+    } else if (arg.starts_with("-O")) {
+      if (arg.size() != 3 || arg[2] < '0' || arg[2] > '3') {
+        std::cerr << "Expected an optimization level of -O0 to -O3" << std::endl;
+        return false;
+      }
+      options.optimization_level = arg[2] - '0';
+    } else if (!arg.starts_with("--")) {
+      command_line.file_names.emplace_back(arg);
+    } else if (arg.starts_with(kBuiltins)) {
+      options.builtins_file = arg.substr(kBuiltins.size());
+    } else if (arg.starts_with(kCacheDir)) {
+      command_line.cache_dir = arg.substr(kCacheDir.size());
+    } else if (arg.starts_with(kProfileGenerate)) {
+      options.profile_generate_file = arg.substr(kProfileGenerate.size());
+    } else if (arg.starts_with(kProfileUse)) {
+      options.profile_use_file = arg.substr(kProfileUse.size());
+    } else if (arg.starts_with(kRuntimeDir)) {
+      options.runtime_dir = arg.substr(kRuntimeDir.size());
+    } else if (arg == "--shared") {
+      options.shared_library = true;
+    } else if (arg == "--run") {
+      command_line.run = true;
+    } else if (arg == "--time") {
+      command_line.print_times = true;
+    } else if (arg == "--embed-runtime") {
+      options.embed_runtime = true;
+    } else if (arg == "--lto") {
+      options.lto = true;
+    } else if (arg == "--release") {
+      options.optimization_level = 3;
+      options.lto = true;
+    } else if (arg == "--split") {
+      options.split_output = true;
+    } else if (arg.starts_with(kSplit)) {
+      options.split_output = true;
+      const std::string_view num_functions = arg.substr(kSplit.size());
+      const auto result = std::from_chars(num_functions.data(),
+                                          num_functions.data() + num_functions.size(),
+                                          options.functions_per_file);
+      if (result.ec != std::errc() ||
+          result.ptr != num_functions.data() + num_functions.size() ||
+          options.functions_per_file == 0) {
+        std::cerr << "Expected a positive number of functions per file after --split=" << std::endl;
+        return false;
+      }
+    } else {
+      std::cerr << "Unrecognized flag " << arg << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Writes code to file_name unless the file already holds exactly that, so
+// build tools see unchanged files as up to date.
+bool WriteFileIfChanged(const std::string& file_name, const std::string& code) {
+  std::ifstream existing(file_name, std::ios_base::binary);
+  if (existing.is_open() &&
+      std::string(std::istreambuf_iterator<char>(existing), std::istreambuf_iterator<char>()) == code) {
+    return true;
+  }
+  existing.close();
+  std::ofstream out(file_name, std::ios_base::binary);
+  out << code;
+  out.close();
+  return out.good();
+}
+
+bool Run(const std::vector<Module>& modules, const CommandLine& command_line) {
+  BytecodeProgram program;
+  const ErrorCode ec = GenerateBytecode(modules, command_line.options, program);
   if (ec.IsFailure()) {
     std::cerr << "Compilation error.\n"
               << ec.ErrorMessage() << std::endl;
     return false;
   }
+  VirtualMachine vm(program);
+  vm.RunMain(command_line.program_args.empty() ? nullptr
+                                                : command_line.program_args[0].c_str());
   return true;
 }
 
-bool Generate(const std::vector<Module>& modules, std::string& code) {
-  const ErrorCode ec = GenerateCode(modules, code);
+bool GenerateSplit(const std::vector<Module>& modules, const CodegenOptions& options,
+                   const std::string& outfname, std::vector<std::string>& cc_files) {
+  std::vector<GeneratedFile> files;
+  const ErrorCode ec = GenerateSplitCode(modules, options, outfname, files);
   if (ec.IsFailure()) {
     std::cerr << "Compilation error.\n"
               << ec.ErrorMessage() << std::endl;
     return false;
   }
+  for (const GeneratedFile& file : files) {
+    if (!WriteFileIfChanged(file.file_name, file.code)) {
+      std::cerr << "Cannot write file " << file.file_name << std::endl;
+      return false;
+    }
+    if (file.file_name.ends_with(".cc")) {
+      cc_files.push_back(file.file_name);
+    }
+  }
   return true;
 }
 
@@ -64,46 +277,93 @@ bool Generate(const std::vector<Module>& modules, std::string& code) {
 }  // namespace pbc
 
 int main(int argc, char** argv) {
-  std::vector<pbc::Module> roots;
-  roots.reserve(argc - 2);
-  const std::string outfname = argv[argc - 1];
-  if (outfname.ends_with(".poiboi")) {
+  pbc::CommandLine command_line{.options = {.runtime_dir = POIBOIC_RUNTIME_DIR}};
+  if (!pbc::ParseArgs(argc, argv, command_line) || command_line.file_names.empty()) {
+    std::cerr << "Usage: poiboic [--builtins=FILE] [--cache-dir=DIR] [--profile-generate=FILE] [--profile-use=FILE] "
+              << "[--runtime-dir=DIR] [--embed-runtime] [--lto] [-O0|-O1|-O2|-O3] [--release] "
+              << "[--shared] [-j N] [--split[=N]] [--time] "
+              << "in.poiboi... out.cc\n"
+              << "       poiboic --run [--cache-dir=DIR] [-j N] [--time] in.poiboi... [-- arg]"
+              << std::endl;
+    return 1;
+  }
+  const pbc::CodegenOptions& options = command_line.options;
+  const std::string& cache_dir = command_line.cache_dir;
+  const std::vector<std::string>& file_names = command_line.file_names;
+  // Every file is an input when running; otherwise the last is the output.
+  const size_t num_inputs = command_line.run ? file_names.size() : file_names.size() - 1;
+  const std::string outfname = file_names.back();
+  if (!command_line.run && outfname.ends_with(".poiboi")) {
     std::cerr << "Final file name should be an output file name, not a .poiboi file." << std::endl;
     return 1;
   }
-  for (int i = 1; i < argc - 1; ++i) {
-    const char* fname = argv[i];
-    std::fstream filehandle;
-    filehandle.open(fname, std::ios_base::in);
-    if (!filehandle.is_open()) {
-      std::cerr << "Compilation failed.\nCannot open file " << std::endl;
-      return 2;
+  // Files are independent until code generation, so they're read in parallel.
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<pbc::Module> roots(num_inputs);
+  std::vector<pbc::FrontEndResult> results(num_inputs);
+  pbc::ParallelFor(num_inputs, options.num_threads, [&](size_t i, int worker) {
+    results[i] = pbc::ReadModule(file_names[i], cache_dir, roots[i]);
+  });
+  const double front_end_seconds = pbc::SecondsSince(start);
+  pbc::FrontEndTimes total_times;
+  for (const pbc::FrontEndResult& result : results) {
+    if (result.exit_code != 0) {
+      std::cerr << result.error << std::endl;
+      return result.exit_code;
     }
-    const std::string code{std::istreambuf_iterator<char>(filehandle),
-                           std::istreambuf_iterator<char>()};
-    filehandle.close();
-    std::vector<std::unique_ptr<pbc::TokenPiece>> tokens;
-    if (!pbc::Scan(code, tokens)) {
-      std::cerr << "Compilation failed while scanning " << fname << std::endl;
-      return 3;
+    total_times.open += result.times.open;
+    total_times.scan += result.times.scan;
+    total_times.parse += result.times.parse;
+  }
+  if (command_line.print_times) {
+    // The stages are summed over files, so may add up to more than the front
+    // end took on several threads.
+    pbc::PrintTime("open", total_times.open);
+    pbc::PrintTime("scan", total_times.scan);
+    pbc::PrintTime("parse", total_times.parse);
+    pbc::PrintTime("front end", front_end_seconds);
+  }
+  if (command_line.run) {
+    return pbc::Run(roots, command_line) ? 0 : 5;
+  }
+  const auto codegen_start = std::chrono::steady_clock::now();
+  std::vector<std::string> cc_files;
+  if (options.split_output) {
+    if (!pbc::GenerateSplit(roots, options, outfname, cc_files)) {
+      std::cerr << "Compilation failed in code generation." << std::endl;
+      return 5;
     }
-    for (auto& token : tokens) {
-      token->set_file_name(fname);
+  } else {
+    // Streamed to a temporary file, which only replaces the output once it's
+    // complete.
+    const std::string tmp_fname = outfname + ".tmp";
+    std::ofstream out(tmp_fname);
+    bool success;
+    {
+      pbc::CodeEmitter emitter(out);
+      success = pbc::Generate(roots, options, emitter);
     }
-    roots.emplace_back();
-    if (!pbc::Parse(tokens, roots.back())) {
-      std::cerr << "Compilation failed while parsing " << fname << std::endl;
-      return 4;
+    out.close();
+    if (!success || !out || std::rename(tmp_fname.c_str(), outfname.c_str()) != 0) {
+      std::remove(tmp_fname.c_str());
+      if (success) {
+        std::cerr << "Cannot write file " << outfname << std::endl;
+      }
+      std::cerr << "Compilation failed in code generation." << std::endl;
+      return 5;
     }
+    cc_files.push_back(outfname);
+  }
+  if (command_line.print_times) {
+    pbc::PrintTime("codegen", pbc::SecondsSince(codegen_start));
+    pbc::PrintTime("total", pbc::SecondsSince(start));
   }
-  std::string code;
-  if (!pbc::Generate(roots, code)) {
-    std::cerr << "Compilation failed in code generation." << std::endl;
+  const pbc::GeneratedFile manifest = pbc::GetBuildManifest(options, outfname, cc_files);
+  if (!pbc::WriteFileIfChanged(manifest.file_name, manifest.code)) {
+    std::cerr << "Cannot write file " << manifest.file_name << std::endl;
     return 5;
   }
-  std::ofstream out(outfname);
-  out << code;
-  out.close();
-  std::cout << "Compilation successful!" << std::endl;
+  std::cout << "Compilation successful!\nBuild with: "
+            << pbc::GetBuildCommand(options, cc_files) << std::endl;
   return 0;
 }
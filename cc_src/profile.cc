@@ -0,0 +1,131 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "profile.h"
+
+#include <fstream>
+
+namespace pbc {
+namespace {
+
+constexpr char kCountersName[] = "_poiboi_profile_counters";
+constexpr char kWriterName[] = "_poiboi_write_profile";
+constexpr char kCallSuffix[] = "/call";
+
+std::string CStringLiteral(const std::string& str) {
+  std::string literal = "\"";
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      literal += '\\';
+    }
+    literal += c;
+  }
+  return literal + "\"";
+}
+
+}  // namespace
+
+ErrorOr<Profile> Profile::Load(const std::string& file_name) {
+  std::ifstream fh(file_name);
+  if (!fh.is_open()) {
+    return ErrorCode::Failure("Cannot open profile file: " + file_name);
+  }
+  Profile profile;
+  std::string line;
+  size_t line_num = 0;
+  while (std::getline(fh, line)) {
+    ++line_num;
+    if (line.empty()) {
+      continue;
+    }
+    const size_t space = line.rfind(' ');
+    char* count_end = nullptr;
+    const uint64_t count = space == std::string::npos
+        ? 0 : strtoull(line.c_str() + space + 1, &count_end, 10);
+    if (count_end == nullptr || *count_end != '\0' || space == 0) {
+      return ErrorCode::Failure("Profile file: " + file_name + "; line: " +
+                                std::to_string(line_num) + "; Malformed counter: " + line);
+    }
+    const std::string key = line.substr(0, space);
+    profile.counts_[key] += count;
+    if (key.ends_with(kCallSuffix)) {
+      profile.total_function_calls_ += count;
+    }
+  }
+  return profile;
+}
+
+uint64_t Profile::GetCount(const std::string& key) const {
+  const auto it = counts_.find(key);
+  return it == counts_.end() ? 0 : it->second;
+}
+
+int FunctionProfile::AddCounter(const std::string& suffix) {
+  counter_keys_.push_back(fn_name_ + "/" + suffix);
+  return counter_keys_.size() - 1;
+}
+
+std::string FunctionProfile::IncrementCode(int counter) const {
+  if (!instrument_) {
+    return "";
+  }
+  return std::string("++") + kCountersName + "[" +
+         std::to_string(counter_base_ + counter) + "];\n";
+}
+
+std::optional<uint64_t> FunctionProfile::GetFeedbackCount(int counter) const {
+  if (feedback_ == nullptr) {
+    return std::nullopt;
+  }
+  return feedback_->GetCount(counter_keys_.at(counter));
+}
+
+std::string GetProfileCountersCode(size_t num_counters) {
+  return std::string("unsigned long long ") + kCountersName + "[" +
+         std::to_string(num_counters == 0 ? 1 : num_counters) + "] = {};\n";
+}
+
+std::string GetProfileCountersDeclarationCode(size_t num_counters) {
+  return std::string("extern unsigned long long ") + kCountersName + "[" +
+         std::to_string(num_counters == 0 ? 1 : num_counters) + "];\n";
+}
+
+std::string GetProfileWriterCode(const std::vector<const FunctionProfile*>& profiles,
+                                 const std::string& file_name) {
+  std::string code = "const char* const _poiboi_profile_keys[] = {\n";
+  size_t num_counters = 0;
+  for (const FunctionProfile* profile : profiles) {
+    for (const std::string& key : profile->counter_keys()) {
+      code += CStringLiteral(key) + ",\n";
+      ++num_counters;
+    }
+  }
+  code += "nullptr};\n";
+  code += std::string("void ") + kWriterName + "() {\n";
+  code += "FILE* profile_file = fopen(" + CStringLiteral(file_name) + ", \"w\");\n";
+  code += "if (profile_file == nullptr) {\nreturn;\n}\n";
+  code += "for (size_t i = 0; i < " + std::to_string(num_counters) + "; ++i) {\n";
+  code += std::string("fprintf(profile_file, \"%s %llu\\n\", _poiboi_profile_keys[i], ") +
+          kCountersName + "[i]);\n}\n";
+  code += "fclose(profile_file);\n}\n";
+  return code;
+}
+
+std::string GetProfileWriterRegistrationCode() {
+  return std::string("atexit(") + kWriterName + ");\n";
+}
+
+}  // namespace pbc
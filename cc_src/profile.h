@@ -0,0 +1,106 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Profile guided optimization. With --profile-generate, the generated program
+// counts function calls, IF arms taken and loop trips, and writes them out on
+// exit. With --profile-use, those counts guide code generation.
+//
+// A profile file has one counter per line: "<key> <count>". Keys look like
+// "Fn/call", "Fn/if3/entry", "Fn/if3/arm1", "Fn/while0/trip", where the
+// numbers are the order the IF or WHILE appears in Fn. So a profile stays
+// valid as long as the functions it covers are unchanged.
+
+#ifndef POIBOIC_PROFILE_H_
+#define POIBOIC_PROFILE_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "error_code.h"
+
+namespace pbc {
+
+class Profile {
+ public:
+  static ErrorOr<Profile> Load(const std::string& file_name);
+
+  // Returns 0 for keys which were never recorded.
+  uint64_t GetCount(const std::string& key) const;
+
+  uint64_t GetTotalFunctionCalls() const { return total_function_calls_; }
+
+ private:
+  std::unordered_map<std::string, uint64_t> counts_;
+  uint64_t total_function_calls_ = 0;
+};
+
+// Profile bookkeeping for a single function, shared by its evaluators.
+class FunctionProfile {
+ public:
+  // instrument: whether to emit counters. feedback may be null.
+  FunctionProfile(std::string fn_name, bool instrument, const Profile* feedback)
+      : fn_name_(std::move(fn_name)), instrument_(instrument), feedback_(feedback) {}
+
+  int NextBranchId() { return num_branches_++; }
+  int NextLoopId() { return num_loops_++; }
+
+  // Registers a counter named fn_name/suffix. Returns its index within this
+  // function.
+  int AddCounter(const std::string& suffix);
+
+  // Code incrementing the counter, or nothing if not instrumenting.
+  std::string IncrementCode(int counter) const;
+
+  // The counter's value in the feedback profile, if there is one.
+  std::optional<uint64_t> GetFeedbackCount(int counter) const;
+
+  const Profile* feedback() const { return feedback_; }
+
+  const std::vector<std::string>& counter_keys() const { return counter_keys_; }
+
+  // Where this function's counters start in the program wide counter array.
+  void set_counter_base(size_t base) { counter_base_ = base; }
+
+ private:
+  std::string fn_name_;
+  bool instrument_{};
+  const Profile* feedback_{};
+  int num_branches_ = 0;
+  int num_loops_ = 0;
+  std::vector<std::string> counter_keys_;
+  size_t counter_base_ = 0;
+};
+
+// Defines the counter array. Goes before any function definitions.
+std::string GetProfileCountersCode(size_t num_counters);
+
+// Declares the counter array defined elsewhere.
+std::string GetProfileCountersDeclarationCode(size_t num_counters);
+
+// Defines the function which writes out all counters to file_name, which main
+// registers with atexit.
+std::string GetProfileWriterCode(const std::vector<const FunctionProfile*>& profiles,
+                                 const std::string& file_name);
+
+// Code for main to run first.
+std::string GetProfileWriterRegistrationCode();
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_PROFILE_H_
@@ -17,14 +17,18 @@ limitations under the License.
 #ifndef POIBOIC_SCANNER_H_
 #define POIBOIC_SCANNER_H_
 
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
 #include "error_code.h"
 #include "tokens.h"
 
 namespace pbc {
 
-// Scans the code and outputs all the tokens. Returns false on failure.
-ErrorCode ScanTokens(const std::string& code,
-                std::vector<std::unique_ptr<TokenPiece>>& tokens);
+// Scans the code and outputs all the tokens, ending with END_OF_FILE. They
+// point into code.
+ErrorCode ScanTokens(std::string_view code, std::vector<Token>& tokens);
 
 }  // namespace pbc
 
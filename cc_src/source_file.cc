@@ -0,0 +1,92 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "source_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace pbc {
+
+ErrorOr<SourceFile> SourceFile::Open(const std::string& file_name) {
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return ErrorCode::Failure("Cannot open file " + file_name);
+  }
+  SourceFile file;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+    void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      // It's about to be scanned once, front to back.
+      madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+      madvise(mapping, file_stat.st_size, MADV_WILLNEED);
+      file.mapping_ = mapping;
+      file.mapping_size_ = file_stat.st_size;
+      file.code_ = std::string_view(static_cast<const char*>(mapping), file_stat.st_size);
+      close(fd);
+      return file;
+    }
+  }
+  char buffer[1 << 16];
+  ssize_t num_read;
+  while ((num_read = read(fd, buffer, sizeof(buffer))) > 0) {
+    file.read_code_.append(buffer, num_read);
+  }
+  close(fd);
+  if (num_read < 0) {
+    return ErrorCode::Failure("Cannot read file " + file_name);
+  }
+  file.code_ = file.read_code_;
+  return file;
+}
+
+SourceFile::SourceFile(SourceFile&& other) {
+  *this = std::move(other);
+}
+
+SourceFile& SourceFile::operator=(SourceFile&& other) {
+  if (this == &other) {
+    return *this;
+  }
+  Unmap();
+  mapping_ = std::exchange(other.mapping_, nullptr);
+  mapping_size_ = std::exchange(other.mapping_size_, 0);
+  read_code_ = std::move(other.read_code_);
+  // A short read_code_ lives inside the string, so moves with it.
+  code_ = mapping_ != nullptr ? other.code_ : std::string_view(read_code_);
+  other.read_code_.clear();
+  other.code_ = {};
+  return *this;
+}
+
+SourceFile::~SourceFile() {
+  Unmap();
+}
+
+void SourceFile::Unmap() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+  }
+}
+
+}  // namespace pbc
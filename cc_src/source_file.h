@@ -0,0 +1,57 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef POIBOIC_SOURCE_FILE_H_
+#define POIBOIC_SOURCE_FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "error_code.h"
+
+namespace pbc {
+
+// A source file's contents, mapped read-only into memory so they're scanned
+// straight from the page cache. Tokens point into the contents, so they're
+// valid for as long as this is.
+class SourceFile {
+ public:
+  // Files which can't be mapped, like pipes, are read instead.
+  static ErrorOr<SourceFile> Open(const std::string& file_name);
+
+  SourceFile(SourceFile&& other);
+  SourceFile& operator=(SourceFile&& other);
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+  ~SourceFile();
+
+  std::string_view code() const { return code_; }
+
+ private:
+  SourceFile() = default;
+  void Unmap();
+
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  // The contents of a file which wasn't mapped.
+  std::string read_code_;
+  std::string_view code_;
+};
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_SOURCE_FILE_H_
@@ -0,0 +1,289 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "structural_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define POIBOIC_STRUCTURAL_INDEX_X86
+#endif
+
+namespace pbc {
+namespace {
+
+// Bit i of each mask is set if byte i of the block is that character.
+struct BlockMasks {
+  uint64_t quote;
+  uint64_t hash;
+  uint64_t backslash;
+  uint64_t newline;
+  uint64_t whitespace;
+};
+
+#ifdef POIBOIC_STRUCTURAL_INDEX_X86
+// Whitespace is ' ' or one of \t, \n, \v, \f, \r, which are 9 to 13. Adding
+// 119 takes exactly those to -128 to -124 as signed bytes.
+inline __m128i WhitespaceSse2(__m128i bytes) {
+  const __m128i control = _mm_cmplt_epi8(_mm_add_epi8(bytes, _mm_set1_epi8(119)),
+                                         _mm_set1_epi8(-123));
+  return _mm_or_si128(control, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+}
+
+inline uint64_t MaskSse2(const __m128i (&bytes)[4], char c) {
+  const __m128i match = _mm_set1_epi8(c);
+  uint64_t mask = 0;
+  for (int i = 0; i < 4; ++i) {
+    mask |= static_cast<uint64_t>(static_cast<uint16_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(bytes[i], match)))) << (16 * i);
+  }
+  return mask;
+}
+
+BlockMasks ClassifySse2(const char* block) {
+  __m128i bytes[4];
+  for (int i = 0; i < 4; ++i) {
+    bytes[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+  }
+  uint64_t whitespace = 0;
+  for (int i = 0; i < 4; ++i) {
+    whitespace |= static_cast<uint64_t>(static_cast<uint16_t>(
+        _mm_movemask_epi8(WhitespaceSse2(bytes[i])))) << (16 * i);
+  }
+  return BlockMasks{.quote = MaskSse2(bytes, '"'), .hash = MaskSse2(bytes, '#'),
+                    .backslash = MaskSse2(bytes, '\\'), .newline = MaskSse2(bytes, '\n'),
+                    .whitespace = whitespace};
+}
+
+__attribute__((target("avx2")))
+inline uint64_t MaskAvx2(__m256i low, __m256i high, __m256i match) {
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, match))) |
+         static_cast<uint64_t>(static_cast<uint32_t>(
+             _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, match)))) << 32;
+}
+
+__attribute__((target("avx2")))
+BlockMasks ClassifyAvx2(const char* block) {
+  const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+  const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+  const __m256i add = _mm256_set1_epi8(119);
+  const __m256i limit = _mm256_set1_epi8(-123);
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i low_whitespace = _mm256_or_si256(
+      _mm256_cmpgt_epi8(limit, _mm256_add_epi8(low, add)), _mm256_cmpeq_epi8(low, space));
+  const __m256i high_whitespace = _mm256_or_si256(
+      _mm256_cmpgt_epi8(limit, _mm256_add_epi8(high, add)), _mm256_cmpeq_epi8(high, space));
+  const uint64_t whitespace =
+      static_cast<uint32_t>(_mm256_movemask_epi8(low_whitespace)) |
+      static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(high_whitespace))) << 32;
+  return BlockMasks{.quote = MaskAvx2(low, high, _mm256_set1_epi8('"')),
+                    .hash = MaskAvx2(low, high, _mm256_set1_epi8('#')),
+                    .backslash = MaskAvx2(low, high, _mm256_set1_epi8('\\')),
+                    .newline = MaskAvx2(low, high, _mm256_set1_epi8('\n')),
+                    .whitespace = whitespace};
+}
+#else
+BlockMasks ClassifyScalar(const char* block) {
+  BlockMasks masks{};
+  for (int i = 0; i < 64; ++i) {
+    const uint64_t bit = uint64_t{1} << i;
+    masks.quote |= block[i] == '"' ? bit : 0;
+    masks.hash |= block[i] == '#' ? bit : 0;
+    masks.backslash |= block[i] == '\\' ? bit : 0;
+    masks.newline |= block[i] == '\n' ? bit : 0;
+    masks.whitespace |= IsWhitespace(block[i]) ? bit : 0;
+  }
+  return masks;
+}
+#endif  // #ifdef POIBOIC_STRUCTURAL_INDEX_X86
+
+// The characters preceded by an odd number of backslashes, from simdjson.
+// prev_escaped carries whether the next block's first character is.
+inline uint64_t FindEscaped(uint64_t backslash, uint64_t& prev_escaped) {
+  backslash &= ~prev_escaped;
+  const uint64_t follows_escape = backslash << 1 | prev_escaped;
+  constexpr uint64_t kEvenBits = 0x5555555555555555ULL;
+  const uint64_t odd_sequence_starts = backslash & ~kEvenBits & ~follows_escape;
+  uint64_t sequences_starting_on_even_bits;
+  prev_escaped = __builtin_add_overflow(odd_sequence_starts, backslash,
+                                        &sequences_starting_on_even_bits);
+  const uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+  return (kEvenBits ^ invert_mask) & follows_escape;
+}
+
+// Bits from bit on.
+inline uint64_t BitsFrom(int bit) {
+  return ~uint64_t{0} << bit;
+}
+
+// Bits after bit.
+inline uint64_t BitsAfter(int bit) {
+  return bit == 63 ? 0 : ~uint64_t{0} << (bit + 1);
+}
+
+// Bit i is the xor of bits 0 to i.
+inline uint64_t PrefixXor(uint64_t bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+enum class Region { CODE, STRING, COMMENT };
+
+// Inlined into a copy for each instruction set, so the bit twiddling gets
+// popcnt and tzcnt along with AVX2.
+template <BlockMasks (*Classify)(const char* block)>
+[[gnu::always_inline]] inline void BuildIndex(std::string_view code, StructuralIndex& index) {
+  // Written through pointers without checking capacity, which is kept at
+  // least a block's worth of entries ahead. Typical code has a run or string
+  // every 8 to 10 bytes.
+  size_t num_entries = 0;
+  const size_t min_size = code.size() / 8 + 64;
+  if (index.offsets.size() < min_size) {
+    index.offsets.resize(min_size);
+    index.lines.resize(min_size);
+  }
+  index.has_unterminated = false;
+  Region region = Region::CODE;
+  uint32_t region_start = 0;
+  uint32_t region_start_line = 0;
+  uint64_t prev_escaped = 0;
+  // Whether the last byte of the previous block was code.
+  uint64_t prev_code = 0;
+  uint32_t lines_before_block = 0;
+  for (size_t block_start = 0; block_start < code.size(); block_start += 64) {
+    const size_t block_size = std::min<size_t>(64, code.size() - block_start);
+    char padded[64];
+    const char* block = code.data() + block_start;
+    if (block_size < 64) {
+      std::memset(padded, ' ', sizeof(padded));
+      std::memcpy(padded, block, block_size);
+      block = padded;
+    }
+    const BlockMasks masks = Classify(block);
+    const uint64_t escaped = FindEscaped(masks.backslash, prev_escaped);
+
+    // Strings and comments, including their delimiters.
+    uint64_t inside = region == Region::CODE ? 0 : ~uint64_t{0};
+    uint64_t string_delimiters = 0;
+    // Without comments, strings are between pairs of unescaped quotes. An
+    // escaped quote can only be taken for an opening one after a backslash
+    // outside a string, which the scanner rejects before getting to it.
+    const uint64_t quotes = masks.quote & ~escaped;
+    const uint64_t strings = PrefixXor(quotes) ^ inside;
+    const bool has_comment = region == Region::COMMENT || (masks.hash & ~strings) != 0;
+    if (!has_comment) {
+      inside = strings | quotes;
+      string_delimiters = quotes;
+      if (__builtin_popcountll(quotes) % 2 == 1) {
+        region = region == Region::CODE ? Region::STRING : Region::CODE;
+      }
+      if (region == Region::STRING && quotes != 0) {
+        const int bit = 63 - __builtin_clzll(quotes);
+        region_start = block_start + bit;
+        region_start_line = lines_before_block +
+                            __builtin_popcountll(masks.newline & ~BitsFrom(bit));
+      }
+    }
+    // Otherwise walks the quotes and #s in order.
+    uint64_t candidates = has_comment ? masks.quote | masks.hash : 0;
+    while (candidates != 0) {
+      const int bit = __builtin_ctzll(candidates);
+      candidates &= candidates - 1;
+      const uint64_t bit_mask = uint64_t{1} << bit;
+      const bool is_quote = (masks.quote & bit_mask) != 0;
+      if (region == Region::CODE) {
+        region = is_quote ? Region::STRING : Region::COMMENT;
+        region_start = block_start + bit;
+        region_start_line = lines_before_block +
+                            __builtin_popcountll(masks.newline & ~BitsFrom(bit));
+        inside |= BitsFrom(bit);
+        string_delimiters |= is_quote ? bit_mask : 0;
+      } else if ((region == Region::STRING && is_quote && (escaped & bit_mask) == 0) ||
+                 (region == Region::COMMENT && !is_quote)) {
+        string_delimiters |= region == Region::STRING ? bit_mask : 0;
+        region = Region::CODE;
+        inside &= ~BitsAfter(bit);
+      }
+    }
+
+    const uint64_t code_bytes = ~(masks.whitespace | inside);
+    const uint64_t run_starts = code_bytes & ~(code_bytes << 1 | prev_code);
+    prev_code = code_bytes >> 63;
+    uint64_t events = run_starts | string_delimiters;
+    if (block_size < 64) {
+      events &= ~BitsFrom(block_size);
+    }
+    if (num_entries + 64 > index.offsets.size()) {
+      index.offsets.resize(2 * index.offsets.size());
+      index.lines.resize(2 * index.lines.size());
+    }
+    uint32_t* offsets = index.offsets.data() + num_entries;
+    uint32_t* lines = index.lines.data() + num_entries;
+    num_entries += __builtin_popcountll(events);
+    while (events != 0) {
+      const int bit = __builtin_ctzll(events);
+      events &= events - 1;
+      *offsets++ = block_start + bit;
+      *lines++ = lines_before_block + __builtin_popcountll(masks.newline & ~BitsFrom(bit));
+    }
+    lines_before_block += __builtin_popcountll(masks.newline);
+  }
+  index.offsets.resize(num_entries);
+  index.lines.resize(num_entries);
+  index.num_newlines = lines_before_block;
+  if (region != Region::CODE) {
+    index.has_unterminated = true;
+    index.unterminated_offset = region_start;
+    index.unterminated_line = region_start_line;
+  }
+}
+
+#ifdef POIBOIC_STRUCTURAL_INDEX_X86
+__attribute__((target("avx2,bmi,popcnt")))
+void BuildIndexAvx2(std::string_view code, StructuralIndex& index) {
+  BuildIndex<ClassifyAvx2>(code, index);
+}
+
+void BuildIndexSse2(std::string_view code, StructuralIndex& index) {
+  BuildIndex<ClassifySse2>(code, index);
+}
+#endif  // #ifdef POIBOIC_STRUCTURAL_INDEX_X86
+
+}  // namespace
+
+void BuildStructuralIndex(std::string_view code, StructuralIndex& index) {
+#ifdef POIBOIC_STRUCTURAL_INDEX_X86
+  static const bool has_avx2 = __builtin_cpu_supports("avx2") &&
+                               __builtin_cpu_supports("bmi") &&
+                               __builtin_cpu_supports("popcnt");
+  if (has_avx2) {
+    BuildIndexAvx2(code, index);
+  } else {
+    BuildIndexSse2(code, index);
+  }
+#else
+  BuildIndex<ClassifyScalar>(code, index);
+#endif
+}
+
+}  // namespace pbc
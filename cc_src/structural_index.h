@@ -0,0 +1,62 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// A first pass over source code which finds where everything the scanner
+// needs to look at starts, classifying 64 bytes at a time with SIMD in the
+// style of simdjson. Quotes, #s, backslashes, newlines and whitespace become
+// bitmasks; the few quotes and #s are then walked in order to find the
+// strings and comments, and everything else is bit arithmetic.
+
+#ifndef POIBOIC_STRUCTURAL_INDEX_H_
+#define POIBOIC_STRUCTURAL_INDEX_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace pbc {
+
+struct StructuralIndex {
+  // Where each run of code between whitespace, strings and comments starts,
+  // and each string's opening quote followed by its closing quote, in order.
+  std::vector<uint32_t> offsets;
+  // The line each offset is on, counted from 0.
+  std::vector<uint32_t> lines;
+  // Lines in the whole source.
+  uint32_t num_newlines = 0;
+  // Set if the source ends in the middle of a string or comment, which
+  // starts at unterminated_offset.
+  bool has_unterminated = false;
+  uint32_t unterminated_offset = 0;
+  uint32_t unterminated_line = 0;
+};
+
+// The code must be under 4GB. Reusing an index saves allocating its memory
+// again.
+void BuildStructuralIndex(std::string_view code, StructuralIndex& index);
+
+// Whether the characters separate runs of code.
+constexpr bool IsWhitespace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' ||
+         c == '\v';
+}
+constexpr bool IsCodeSeparator(char c) {
+  return IsWhitespace(c) || c == '"' || c == '#';
+}
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_STRUCTURAL_INDEX_H_
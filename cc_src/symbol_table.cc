@@ -0,0 +1,46 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "symbol_table.h"
+
+#include <cassert>
+
+namespace pbc {
+
+void ScopedSymbolTable::Bind(Symbol symbol, Binding binding) {
+  assert(!scope_starts_.empty());
+  if (symbol >= bindings_.size()) {
+    bindings_.resize(symbol + 1, Binding::UNDEFINED);
+  }
+  if (bindings_[symbol] == binding) {
+    return;
+  }
+  undo_log_.push_back({symbol, bindings_[symbol]});
+  bindings_[symbol] = binding;
+}
+
+void ScopedSymbolTable::ExitScope() {
+  assert(!scope_starts_.empty());
+  const size_t start = scope_starts_.back();
+  scope_starts_.pop_back();
+  // Undone newest first, so each symbol ends up as it was on entry.
+  while (undo_log_.size() > start) {
+    bindings_[undo_log_.back().symbol] = undo_log_.back().previous;
+    undo_log_.pop_back();
+  }
+}
+
+}  // namespace pbc
@@ -0,0 +1,79 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Tracks which variables are defined, and how, while a function is analyzed.
+
+#ifndef POIBOIC_SYMBOL_TABLE_H_
+#define POIBOIC_SYMBOL_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ast_arena.h"
+
+namespace pbc {
+
+enum class Binding : uint8_t {
+  UNDEFINED,
+  LOCAL,
+  GLOBAL,
+};
+
+// The bindings of every scope enclosing the code being analyzed. Nested
+// scopes share the table: binding a symbol logs what it replaced, and leaving
+// a scope undoes its log. So analysis never copies a scope, and lookups index
+// by symbol rather than hashing names.
+class ScopedSymbolTable {
+ public:
+  // Enters a scope for as long as it lives.
+  class Scope {
+   public:
+    explicit Scope(ScopedSymbolTable& table) : table_(table) { table_.EnterScope(); }
+    ~Scope() { table_.ExitScope(); }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    ScopedSymbolTable& table_;
+  };
+
+  Binding Lookup(Symbol symbol) const {
+    return symbol < bindings_.size() ? bindings_[symbol] : Binding::UNDEFINED;
+  }
+
+  // Lasts until the innermost scope is left.
+  void Bind(Symbol symbol, Binding binding);
+
+ private:
+  struct Undo {
+    Symbol symbol;
+    Binding previous;
+  };
+
+  void EnterScope() { scope_starts_.push_back(undo_log_.size()); }
+  void ExitScope();
+
+  // Indexed by symbol. Only grows, so a table reused for many functions
+  // allocates just once.
+  std::vector<Binding> bindings_;
+  std::vector<Undo> undo_log_;
+  std::vector<size_t> scope_starts_;
+};
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_SYMBOL_TABLE_H_
@@ -14,431 +14,288 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
-// Contains a list of all tokens in PoiBoi, and functions defining what
-// sequences of characters satisfy them.
+// Contains a list of all tokens in PoiBoi. The scanner recognizes them by the
+// fixed tokens' contents and the letter classes of the rest.
 
 #ifndef POIBOIC_TOKENS_H_
 #define POIBOIC_TOKENS_H_
 
+#include <array>
+#include <cassert>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <iostream>
 
 #include "grammar_piece.h"
 
 namespace pbc {
 
+// The characters Variables, Builtins and FunctionNames are made of.
+constexpr bool IsLowerCaseLetter(char c) { return c >= 'a' && c <= 'z'; }
+constexpr bool IsUpperCaseLetter(char c) { return c >= 'A' && c <= 'Z'; }
+
 class TokenPiece : public GrammarPiece {
  public:
+  explicit TokenPiece(GrammarLabel label) : GrammarPiece(label) {}
   virtual ~TokenPiece() {};
-  virtual bool Search(char c) = 0;
   virtual size_t GetLength() const = 0;
-  virtual bool IsFinalizable() const = 0;
-
-  std::vector<std::vector<std::unique_ptr<GrammarPiece>>>
-  GetDescendents() const override { return {}; }
-
-  // Copy the contents of this to other. Only works if other is of the same derived type as this.
-  virtual void CopyTokenTo(TokenPiece* other) const = 0;
-
- protected:
-  void CloneTPBase(TokenPiece* tp) const {
-    CloneGPBase(tp);
-  }
 };
 
-// A token piece that can be found through simple string matching.
+// A token piece that can be found through simple string matching, with the
+// string in Derived::kContent and label in Derived::kLabel.
 template<typename Derived>
 class MatchTokenPiece : public TokenPiece {
  public:
+  MatchTokenPiece() : TokenPiece(Derived::kLabel) {}
   virtual ~MatchTokenPiece() {};
 
-  bool Search(char c) override {
-    if (num_chars_processed_ < GetLength()) {
-      hit_error_ = hit_error_ || c != GetContent()[num_chars_processed_];
-      if (!hit_error_) {
-        num_chars_processed_++;
-        return true;
-      }
-    }
-    return false;
-  }
-
-  bool IsFinalizable() const override {
-    return num_chars_processed_ >= GetLength();
-  }
+  size_t GetLength() const override { return sizeof(Derived::kContent) - 1; }
+  const char* GetContent() const override { return Derived::kContent; }
 
   const char* DebugDescription() const override {
     return GetContent();
   }
+};
 
-  void CopyTokenTo(TokenPiece* other) const override {
-    CloneTPBase(other);
-    auto& o = dynamic_cast<MatchTokenPiece<Derived>&>(*other);
-    o.hit_error_ = hit_error_;
-    o.num_chars_processed_ = num_chars_processed_;
-  }
+// Tokens whose content varies. Every other token's content is implied by its
+// label.
+constexpr bool HasVariableContent(GrammarLabel label) {
+  return label == GrammarLabel::QUOTED_STRING || label == GrammarLabel::VARIABLE ||
+         label == GrammarLabel::BUILTIN || label == GrammarLabel::FUNCTION_NAME;
+}
 
-  std::unique_ptr<GrammarPiece> Clone() const override {
-    std::unique_ptr<MatchTokenPiece<Derived>> gp(new Derived);
-    CopyTokenTo(gp.get());
-    return std::unique_ptr<GrammarPiece>(gp.release());
-  }
+// A token piece whose content varies.
+class ContentTokenPiece : public TokenPiece {
+ public:
+  explicit ContentTokenPiece(GrammarLabel label) : TokenPiece(label) {}
+
+  const char* GetContent() const override { return content_.data(); }
+
+  size_t GetLength() const override { return content_.size(); }
+
+  // content must last as long as this and be followed by a NUL, as from
+  // AstArena::CopyString.
+  void set_content(std::string_view content) { content_ = content; }
 
  private:
-  size_t num_chars_processed_ = 0;
-  bool hit_error_ = false;
+  std::string_view content_ = "";
 };
 
 // Opens a block of code with {, after an IF, WHILE, or function definition.
 class OpenCodeBlock : public MatchTokenPiece<OpenCodeBlock> {
  public:
-  size_t GetLength() const override { return 1; }
-  const char* GetContent() const override { return "{"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::OPEN_CODE_BLOCK;
-  }
+  static constexpr char kContent[] = "{";
+  static constexpr GrammarLabel kLabel = GrammarLabel::OPEN_CODE_BLOCK;
 };
 
 // Closes a block of code with }, matches an OpenCodeBlock.
 class CloseCodeBlock : public MatchTokenPiece<CloseCodeBlock> {
  public:
-  size_t GetLength() const override { return 1; }
-  const char* GetContent() const override { return "}"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::CLOSE_CODE_BLOCK;
-  }
+  static constexpr char kContent[] = "}";
+  static constexpr GrammarLabel kLabel = GrammarLabel::CLOSE_CODE_BLOCK;
 };
 
 // Ends most lines of code with ;.
 class EndStatement : public MatchTokenPiece<EndStatement> {
  public:
-  size_t GetLength() const override { return 1; }
-  const char* GetContent() const override { return ";"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::END_STATEMENT;
-  }
+  static constexpr char kContent[] = ";";
+  static constexpr GrammarLabel kLabel = GrammarLabel::END_STATEMENT;
 };
 
 // Opens the variables list when calling or declaring a function with (.
 class OpenFunctionCall : public MatchTokenPiece<OpenFunctionCall> {
  public:
-  size_t GetLength() const override { return 1; }
-  const char* GetContent() const override { return "("; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::OPEN_FUNCTION_CALL;
-  }
+  static constexpr char kContent[] = "(";
+  static constexpr GrammarLabel kLabel = GrammarLabel::OPEN_FUNCTION_CALL;
 };
 
 // Closes the variables list when calling or declaring a function with ).
 class CloseFunctionCall : public MatchTokenPiece<CloseFunctionCall> {
  public:
-  size_t GetLength() const override { return 1; }
-  const char* GetContent() const override { return ")"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::CLOSE_FUNCTION_CALL;
-  }
+  static constexpr char kContent[] = ")";
+  static constexpr GrammarLabel kLabel = GrammarLabel::CLOSE_FUNCTION_CALL;
 };
 
 // Separates variables in list when calling or declaring a function with ,.
 class ArgumentListSeparator : public MatchTokenPiece<ArgumentListSeparator> {
  public:
-  size_t GetLength() const override { return 1; }
-  const char* GetContent() const override { return ","; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::ARGUMENT_LIST_SEPARATOR;
-  }
+  static constexpr char kContent[] = ",";
+  static constexpr GrammarLabel kLabel = GrammarLabel::ARGUMENT_LIST_SEPARATOR;
 };
 
 // Opens the conditional in an IF or WHILE with [.
 class OpenConditionalBlock : public MatchTokenPiece<OpenConditionalBlock> {
  public:
-  size_t GetLength() const override { return 1; }
-  const char* GetContent() const override { return "["; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::OPEN_CONDITIONAL_BLOCK;
-  }
+  static constexpr char kContent[] = "[";
+  static constexpr GrammarLabel kLabel = GrammarLabel::OPEN_CONDITIONAL_BLOCK;
 };
 
 // Closes OpenConditionalBlock with ].
 class CloseConditionalBlock : public MatchTokenPiece<CloseConditionalBlock> {
  public:
-  size_t GetLength() const override { return 1; }
-  const char* GetContent() const override { return "]"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::CLOSE_CONDITIONAL_BLOCK;
-  }
+  static constexpr char kContent[] = "]";
+  static constexpr GrammarLabel kLabel = GrammarLabel::CLOSE_CONDITIONAL_BLOCK;
 };
 
 // Assigns an RValue to a variable with =.
 class Assigner : public MatchTokenPiece<Assigner> {
  public:
-  size_t GetLength() const override { return 1; }
-  const char* GetContent() const override { return "="; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::ASSIGNER;
-  }
+  static constexpr char kContent[] = "=";
+  static constexpr GrammarLabel kLabel = GrammarLabel::ASSIGNER;
 };
 
 // Specifies a variable is a global variable.
 class KeywordGlobal : public MatchTokenPiece<KeywordGlobal> {
  public:
-  size_t GetLength() const override { return 6; }
-  const char* GetContent() const override { return "GLOBAL"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::KEYWORD_GLOBAL;
-  }
+  static constexpr char kContent[] = "GLOBAL";
+  static constexpr GrammarLabel kLabel = GrammarLabel::KEYWORD_GLOBAL;
 };
 
 // Starts a WHILE loop.
 class KeywordWhile : public MatchTokenPiece<KeywordWhile> {
  public:
-  size_t GetLength() const override { return 5; }
-  const char* GetContent() const override { return "WHILE"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::KEYWORD_WHILE;
-  }
+  static constexpr char kContent[] = "WHILE";
+  static constexpr GrammarLabel kLabel = GrammarLabel::KEYWORD_WHILE;
 };
 
 // Starts an IF statement.
 class KeywordIf : public MatchTokenPiece<KeywordIf> {
  public:
-  size_t GetLength() const override { return 2; }
-  const char* GetContent() const override { return "IF"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::KEYWORD_IF;
-  }
+  static constexpr char kContent[] = "IF";
+  static constexpr GrammarLabel kLabel = GrammarLabel::KEYWORD_IF;
 };
 
 // Following an if statement, tarts an ELSE clase.
 class KeywordElse : public MatchTokenPiece<KeywordElse> {
  public:
-  size_t GetLength() const override { return 4; }
-  const char* GetContent() const override { return "ELSE"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::KEYWORD_ELSE;
-  }
+  static constexpr char kContent[] = "ELSE";
+  static constexpr GrammarLabel kLabel = GrammarLabel::KEYWORD_ELSE;
 };
 
 // Starts following an if statement, starts an "else if" clause.
 class KeywordElif : public MatchTokenPiece<KeywordElif> {
  public:
-  size_t GetLength() const override { return 4; }
-  const char* GetContent() const override { return "ELIF"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::KEYWORD_ELIF;
-  }
+  static constexpr char kContent[] = "ELIF";
+  static constexpr GrammarLabel kLabel = GrammarLabel::KEYWORD_ELIF;
 };
 
 // Allows early termination from a function.
 class KeywordReturn : public MatchTokenPiece<KeywordReturn> {
  public:
-  size_t GetLength() const override { return 6; }
-  const char* GetContent() const override { return "RETURN"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::KEYWORD_RETURN;
-  }
+  static constexpr char kContent[] = "RETURN";
+  static constexpr GrammarLabel kLabel = GrammarLabel::KEYWORD_RETURN;
 };
 
 // Allows early termination from a loop.
 class KeywordBreak : public MatchTokenPiece<KeywordBreak> {
  public:
-  size_t GetLength() const override { return 5; }
-  const char* GetContent() const override { return "BREAK"; }
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::KEYWORD_BREAK;
-  }
+  static constexpr char kContent[] = "BREAK";
+  static constexpr GrammarLabel kLabel = GrammarLabel::KEYWORD_BREAK;
 };
 
-// Reads a string of anything between and including "", other than newlines.
-class QuotedString : public TokenPiece {
- public:
-  std::unique_ptr<GrammarPiece> Clone() const override {
-    std::unique_ptr<QuotedString> gp(new QuotedString);
-    CopyTokenTo(gp.get());
-    return std::unique_ptr<GrammarPiece>(gp.release());
-  }
-
-  void CopyTokenTo(TokenPiece* other) const override {
-    CloneTPBase(other);
-    auto& o = dynamic_cast<QuotedString&>(*other);
-    o.content_ = content_;
-    o.num_backslashes_in_row_ = num_backslashes_in_row_;
-    o.no_more_ = no_more_;
-    o.is_finalized_ = is_finalized_;
-  }
-
-  bool Search(char c) override;
+// A token matching a fixed string.
+struct FixedToken {
+  std::string_view content;
+  GrammarLabel label;
+};
 
-  const char* GetContent() const override { return content_.c_str(); }
+template <typename... Tokens>
+constexpr std::array<FixedToken, sizeof...(Tokens)> MakeFixedTokens() {
+  return {FixedToken{Tokens::kContent, Tokens::kLabel}...};
+}
 
-  size_t GetLength() const override { return content_.size(); }
+// All the MatchTokenPieces, which the scanner builds its tables from.
+constexpr auto kFixedTokens = MakeFixedTokens<
+    OpenCodeBlock, CloseCodeBlock, EndStatement, OpenFunctionCall,
+    CloseFunctionCall, ArgumentListSeparator, OpenConditionalBlock, CloseConditionalBlock,
+    Assigner, KeywordGlobal, KeywordWhile, KeywordIf,
+    KeywordElse, KeywordElif, KeywordReturn, KeywordBreak>();
 
-  bool IsFinalizable() const override {
-    return is_finalized_ && !content_.empty();
-  }
+// Reads a string of anything between and including "", other than newlines.
+class QuotedString : public ContentTokenPiece {
+ public:
+  static constexpr GrammarLabel kLabel = GrammarLabel::QUOTED_STRING;
 
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::QUOTED_STRING;
-  }
+  QuotedString() : ContentTokenPiece(kLabel) {}
 
   const char* DebugDescription() const override {
     return "\"A quoted string- like this.\"";
   }
-
- private:
-  std::string content_;
-  size_t num_backslashes_in_row_ = 0;
-  bool no_more_ = false;
-  bool is_finalized_ = false;
 };
 
 // Reads in the name of a variable. Must only contain letters and must start
 // with a lower case letter.
-class Variable : public TokenPiece {
+class Variable : public ContentTokenPiece {
  public:
-  std::unique_ptr<GrammarPiece> Clone() const override {
-    std::unique_ptr<Variable> gp(new Variable);
-    CopyTokenTo(gp.get());
-    return std::unique_ptr<GrammarPiece>(gp.release());
-  }
-
-  void CopyTokenTo(TokenPiece* other) const override {
-    CloneTPBase(other);
-    auto& o = dynamic_cast<Variable&>(*other);
-    o.content_ = content_;
-    o.no_more_ = no_more_;
-  }
-
-  bool Search(char c) override;
-
-  const char* GetContent() const override { return content_.c_str(); }
-
-  size_t GetLength() const override { return content_.size(); }
-
-  bool IsFinalizable() const override { return !content_.empty(); }
+  static constexpr GrammarLabel kLabel = GrammarLabel::VARIABLE;
 
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::VARIABLE;
-  }
+  Variable() : ContentTokenPiece(kLabel) {}
 
   const char* DebugDescription() const override {
     return "aValidVariableName";
   }
 
+  // The interned content, set along with it.
+  Symbol symbol() const { return symbol_; }
+  void set_symbol(Symbol symbol) { symbol_ = symbol; }
+
  private:
-  std::string content_;
-  bool no_more_ = false;
+  Symbol symbol_ = 0;
 };
 
 // Builtin functions are all capital letters.
-class Builtin : public TokenPiece {
+class Builtin : public ContentTokenPiece {
  public:
-  std::unique_ptr<GrammarPiece> Clone() const override {
-    std::unique_ptr<Builtin> gp(new Builtin);
-    CopyTokenTo(gp.get());
-    return std::unique_ptr<GrammarPiece>(gp.release());
-  }
-
-  void CopyTokenTo(TokenPiece* other) const override {
-    CloneTPBase(other);
-    auto& o = dynamic_cast<Builtin&>(*other);
-    o.content_ = content_;
-    o.no_more_ = no_more_;
-  }
-
-  bool Search(char c) override;
+  static constexpr GrammarLabel kLabel = GrammarLabel::BUILTIN;
 
-  const char* GetContent() const override { return content_.c_str(); }
-
-  size_t GetLength() const override { return content_.size(); }
-
-  bool IsFinalizable() const override { return !content_.empty(); }
-
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::BUILTIN;
-  }
+  Builtin() : ContentTokenPiece(kLabel) {}
 
   const char* DebugDescription() const override {
     return "AVALIDBUILTINNAME";
   }
-
- private:
-  std::string content_;
-  bool no_more_ = false;
 };
 
 // FunctionNames are all capital and lower case letters. Must start with a
 // capital letter, and contain a lower case letter.
-class FunctionName : public TokenPiece {
+class FunctionName : public ContentTokenPiece {
  public:
-  std::unique_ptr<GrammarPiece> Clone() const override {
-    std::unique_ptr<FunctionName> gp(new FunctionName);
-    CopyTokenTo(gp.get());
-    return std::unique_ptr<GrammarPiece>(gp.release());
-  }
-
-  void CopyTokenTo(TokenPiece* other) const override {
-    CloneTPBase(other);
-    auto& o = dynamic_cast<FunctionName&>(*other);
-    o.content_ = content_;
-    o.no_more_ = no_more_;
-    o.contains_lower_case_ = contains_lower_case_;
-  }
-
-  bool Search(char c) override;
+  static constexpr GrammarLabel kLabel = GrammarLabel::FUNCTION_NAME;
 
-  const char* GetContent() const override { return content_.c_str(); }
-
-  size_t GetLength() const override { return content_.size(); }
-
-  bool IsFinalizable() const override {
-    return !content_.empty() && contains_lower_case_;
-  }
-
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::FUNCTION_NAME;
-  }
+  FunctionName() : ContentTokenPiece(kLabel) {}
 
   const char* DebugDescription() const override {
     return "AValidFunctionName";
   }
-
- private:
-  std::string content_;
-  bool no_more_ = false;
-  bool contains_lower_case_ = false;
 };
 
 // Marks the end of the file. Is artificially added at the end if everything
 // is scanned correctly.
 class EndOfFile : public TokenPiece {
  public:
-  std::unique_ptr<GrammarPiece> Clone() const override {
-    std::unique_ptr<EndOfFile> gp(new EndOfFile);
-    CopyTokenTo(gp.get());
-    return std::unique_ptr<GrammarPiece>(gp.release());
-  }
-
-  void CopyTokenTo(TokenPiece* other) const override {
-    CloneTPBase(other);
-    assert(other->GetLabel() == this->GetLabel());
-  }
+  static constexpr GrammarLabel kLabel = GrammarLabel::END_OF_FILE;
 
-  bool Search(char c) override { return false; }
+  EndOfFile() : TokenPiece(kLabel) {}
 
   const char* GetContent() const override { return ""; }
 
   size_t GetLength() const override { return 0; }
 
-  bool IsFinalizable() const override { return true; }
-
   const char* DebugDescription() const override {
     return "The end of the file";
   }
+};
 
-  GrammarLabel GetLabel() const override {
-    return GrammarLabel::END_OF_FILE;
-  }
+// A scanned token, as a view of its text in the source. Its TokenPiece is only
+// made when the parser places it in the tree.
+struct Token {
+  GrammarLabel label;
+  uint32_t offset;
+  uint32_t length;
+  // Counted from 0.
+  uint32_t line;
+
+  std::string_view Text(std::string_view code) const { return code.substr(offset, length); }
 };
 
 }  // namespace pbc
@@ -0,0 +1,183 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "variable_analysis.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace pbc {
+namespace {
+
+// PBString::StringToSize rejects anything with 20 or more characters, so
+// stay below that.
+constexpr size_t kMaxSizeLiteralDigits = 19;
+
+void CollectFromCodeBlock(const CodeBlock& code_block,
+                          VariableAssignments& out);
+
+void CollectFromElseStatement(const ElseStatement& else_statement,
+                              VariableAssignments& out) {
+  const ElseStatement* curr = &else_statement;
+  while (curr->GetChildren().size() != 0) {
+    if (curr->GetChildren().size() == 2) {
+      // ELSE statement.
+      CollectFromCodeBlock(GetChild<CodeBlock, 1>(*curr), out);
+      return;
+    }
+    // ELIF statement.
+    CollectFromCodeBlock(GetChild<CodeBlock, 2>(*curr), out);
+    curr = &GetChild<ElseStatement, 3>(*curr);
+  }
+}
+
+void CollectFromStatement(const Statement& statement, VariableAssignments& out) {
+  VisitChild<0, VariableAssignment, GlobalDeclaration, FunctionCall, KeywordWhile, KeywordIf,
+             KeywordReturn, KeywordBreak>(statement, Visitor{
+      [&](const VariableAssignment& va) {
+        out.assignments[GetChild<Variable, 0>(va).GetContent()].push_back(
+            &GetChild<RValue, 2>(va));
+      },
+      [&](const GlobalDeclaration& gd) {
+        out.declared_globals.insert(GetChild<Variable, 1>(gd).GetContent());
+      },
+      [&](const KeywordWhile&) { CollectFromCodeBlock(GetChild<CodeBlock, 2>(statement), out); },
+      [&](const KeywordIf&) {
+        CollectFromCodeBlock(GetChild<CodeBlock, 2>(statement), out);
+        CollectFromElseStatement(GetChild<ElseStatement, 3>(statement), out);
+      },
+      // Nothing else assigns.
+      [](const FunctionCall&) {},
+      [](const KeywordReturn&) {},
+      [](const KeywordBreak&) {}});
+}
+
+void CollectFromCodeBlock(const CodeBlock& code_block,
+                          VariableAssignments& out) {
+  for (const GrammarPiece* statement : GetChild<StatementList, 1>(code_block).GetChildren()) {
+    CollectFromStatement(PieceCast<Statement>(*statement), out);
+  }
+}
+
+}  // namespace
+
+VariableAssignments CollectVariableAssignments(const CodeBlock& code_block) {
+  VariableAssignments out;
+  CollectFromCodeBlock(code_block, out);
+  return out;
+}
+
+bool IsCanonicalSizeLiteral(const QuotedString& quoted_string, size_t& value) {
+  const char* content = quoted_string.GetContent();
+  const size_t length = strlen(content);
+  // Content includes the surrounding quotes.
+  if (length < 3 || length - 2 > kMaxSizeLiteralDigits) {
+    return false;
+  }
+  const char* digits = content + 1;
+  const size_t num_digits = length - 2;
+  if (digits[0] == '0' && num_digits != 1) {
+    return false;
+  }
+  value = 0;
+  for (size_t i = 0; i < num_digits; ++i) {
+    if (digits[i] < '0' || digits[i] > '9') {
+      return false;
+    }
+    value = value * 10 + (digits[i] - '0');
+  }
+  return true;
+}
+
+bool ResolveSubstringIndexLiteral(const QuotedString& quoted_string,
+                                  std::optional<size_t>& index) {
+  const char* content = quoted_string.GetContent();
+  if (strchr(content, '\\') != nullptr) {
+    return false;
+  }
+  index.reset();
+  const size_t length = strlen(content);
+  assert(length >= 2);
+  const size_t num_digits = length - 2;
+  if (num_digits == 0 || num_digits > kMaxSizeLiteralDigits) {
+    return true;
+  }
+  size_t value = 0;
+  for (size_t i = 1; i <= num_digits; ++i) {
+    if (content[i] < '0' || content[i] > '9') {
+      return true;
+    }
+    value = value * 10 + (content[i] - '0');
+  }
+  index = value;
+  return true;
+}
+
+bool IsSizeRValue(const RValue& rvalue,
+                  const std::unordered_set<std::string>& size_variables) {
+  return VisitChild<0, QuotedString, Variable, FunctionCall>(rvalue, Visitor{
+      [](const QuotedString& quoted_string) {
+        size_t unused;
+        return IsCanonicalSizeLiteral(quoted_string, unused);
+      },
+      [&](const Variable& variable) {
+        return size_variables.count(variable.GetContent()) == 1;
+      },
+      [](const FunctionCall& fc) {
+        const auto& fn = *fc.GetChildren()[0];
+        return fn.GetLabel() == GrammarLabel::BUILTIN &&
+               strcmp(fn.GetContent(), "STRLEN") == 0;
+      }});
+}
+
+std::unordered_set<std::string> InferSizeVariables(
+    const Function& fn, const VariableAssignments& assignments) {
+  // Start optimistic and knock out any variable with an assignment that isn't
+  // size shaped until nothing changes. Assigning one size variable to another
+  // keeps both, so loops like "a = b; b = a;" settle correctly.
+  std::unordered_set<std::string> size_variables;
+  for (const auto& [name, rvalues] : assignments.assignments) {
+    size_variables.insert(name);
+  }
+  for (const std::string& input_var : fn.GetVariablesList()) {
+    size_variables.erase(input_var);
+  }
+  for (const std::string& global : assignments.declared_globals) {
+    size_variables.erase(global);
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = size_variables.begin(); it != size_variables.end();) {
+      bool all_sizes = true;
+      for (const RValue* rvalue : assignments.assignments.at(*it)) {
+        if (!IsSizeRValue(*rvalue, size_variables)) {
+          all_sizes = false;
+          break;
+        }
+      }
+      if (all_sizes) {
+        ++it;
+      } else {
+        it = size_variables.erase(it);
+        changed = true;
+      }
+    }
+  }
+  return size_variables;
+}
+
+}  // namespace pbc
@@ -0,0 +1,68 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Whole-function analyses over variables which run before evaluators are
+// created, since evaluators only see the code above them.
+
+#ifndef POIBOIC_VARIABLE_ANALYSIS_H_
+#define POIBOIC_VARIABLE_ANALYSIS_H_
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "function.h"
+#include "grammar.h"
+#include "tokens.h"
+
+namespace pbc {
+
+// Every assignment made in a function, keyed by variable name, as well as
+// every name declared GLOBAL anywhere in the function.
+struct VariableAssignments {
+  std::unordered_map<std::string, std::vector<const RValue*>> assignments;
+  std::unordered_set<std::string> declared_globals;
+};
+
+VariableAssignments CollectVariableAssignments(const CodeBlock& code_block);
+
+// If quoted_string is a canonical non-negative integer (no sign, no leading
+// zeroes, small enough to survive PBString::StringToSize), sets value and
+// returns true.
+bool IsCanonicalSizeLiteral(const QuotedString& quoted_string, size_t& value);
+
+// If quoted_string contains no escape sequences, what SUBSTRING reads from
+// it as an index is known at compile time. In that case returns true and sets
+// index, leaving it empty if SUBSTRING would fall back to its default.
+bool ResolveSubstringIndexLiteral(const QuotedString& quoted_string,
+                                  std::optional<size_t>& index);
+
+// Returns true if the rvalue is STRLEN(...), a canonical size literal, or a
+// variable in size_variables.
+bool IsSizeRValue(const RValue& rvalue,
+                  const std::unordered_set<std::string>& size_variables);
+
+// Returns the local variables of fn which provably only ever hold canonical
+// non-negative integers. These can be stored as size_t rather than PBString.
+// Function arguments and anything declared GLOBAL are never included.
+std::unordered_set<std::string> InferSizeVariables(
+    const Function& fn, const VariableAssignments& assignments);
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_VARIABLE_ANALYSIS_H_
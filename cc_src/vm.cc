@@ -0,0 +1,167 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "vm.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+// GCC and Clang can jump straight from one instruction's handler to the
+// next's through a table of label addresses, which predicts far better than
+// a switch in a loop.
+#if defined(__GNUC__)
+#define POIBOIC_VM_COMPUTED_GOTO
+#endif
+
+namespace pbc {
+
+VirtualMachine::VirtualMachine(const BytecodeProgram& program)
+    : program_(program), globals_(program.globals.size()) {
+  constants_.reserve(program.constants.size());
+  for (const std::string& constant : program.constants) {
+    // Like a C++ string literal, a constant ends at its first '\0'.
+    constants_.push_back(PBString::NewStaticString(constant.c_str()));
+  }
+}
+
+void VirtualMachine::RunMain(const char* arg) {
+  const BytecodeFunction& main_fn = program_.functions.at(program_.main_function);
+  registers_.resize(std::max<size_t>(main_fn.num_registers, 1));
+  if (main_fn.num_args == 1) {
+    registers_[0] = arg == nullptr ? PBString() : PBString::NewStaticString(arg);
+  }
+  Execute(main_fn, 0);
+}
+
+PBString VirtualMachine::Execute(const BytecodeFunction& fn, size_t base) {
+  const Instruction* const code = fn.code.data();
+  const Instruction* pc = code;
+  PBString* regs = registers_.data() + base;
+  // Clears this call's registers, so nothing outlives it that wouldn't in a
+  // compiled program.
+  auto release_registers = [this, base, &fn]() {
+    std::fill_n(registers_.begin() + base, fn.num_registers, PBString());
+  };
+
+#ifdef POIBOIC_VM_COMPUTED_GOTO
+  // In Opcode order.
+  static const void* const kDispatchTable[] = {
+      &&op_LOAD_CONSTANT, &&op_LOAD_GLOBAL, &&op_STORE_GLOBAL, &&op_MOVE, &&op_CALL,
+      &&op_EQUAL, &&op_PRINT, &&op_CONCAT, &&op_NOT, &&op_AND, &&op_OR, &&op_STRLEN,
+      &&op_SUBSTRING, &&op_JUMP, &&op_JUMP_IF_FALSE, &&op_RETURN, &&op_RETURN_EMPTY,
+  };
+  static_assert(std::size(kDispatchTable) == static_cast<size_t>(Opcode::RETURN_EMPTY) + 1);
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() goto *kDispatchTable[static_cast<size_t>(pc->op)]
+  VM_DISPATCH();
+#else
+#define VM_CASE(name) case Opcode::name:
+#define VM_DISPATCH() continue
+  for (;;) {
+    switch (pc->op) {
+#endif
+
+  VM_CASE(LOAD_CONSTANT)
+    regs[pc->a] = constants_[pc->b];
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(LOAD_GLOBAL)
+    regs[pc->a] = globals_[pc->b];
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(STORE_GLOBAL)
+    globals_[pc->a] = regs[pc->b];
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(MOVE)
+    regs[pc->a] = regs[pc->b];
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(CALL) {
+    const BytecodeFunction& callee = program_.functions[pc->b];
+    const size_t callee_base = base + fn.num_registers;
+    const size_t needed = callee_base + callee.num_registers;
+    if (needed > registers_.size()) {
+      registers_.resize(std::max(needed, 2 * registers_.size()));
+      regs = registers_.data() + base;
+    }
+    for (uint32_t i = 0; i < pc->d; ++i) {
+      registers_[callee_base + i] = regs[pc->c + i];
+    }
+    PBString result = Execute(callee, callee_base);
+    // The callee may have grown the registers.
+    regs = registers_.data() + base;
+    regs[pc->a] = std::move(result);
+    ++pc;
+    VM_DISPATCH();
+  }
+  VM_CASE(EQUAL)
+    regs[pc->a] = Builtin_Equal(regs[pc->b], regs[pc->c]);
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(PRINT)
+    regs[pc->a] = Builtin_Print(regs[pc->b]);
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(CONCAT)
+    regs[pc->a] = Builtin_Concat(regs[pc->b], regs[pc->c]);
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(NOT)
+    regs[pc->a] = Builtin_Not(regs[pc->b]);
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(AND)
+    regs[pc->a] = Builtin_And(regs[pc->b], regs[pc->c]);
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(OR)
+    regs[pc->a] = Builtin_Or(regs[pc->b], regs[pc->c]);
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(STRLEN)
+    regs[pc->a] = Builtin_Strlen(regs[pc->b]);
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(SUBSTRING)
+    regs[pc->a] = Builtin_Substring(regs[pc->b], regs[pc->c], regs[pc->d]);
+    ++pc;
+    VM_DISPATCH();
+  VM_CASE(JUMP)
+    pc = code + pc->a;
+    VM_DISPATCH();
+  VM_CASE(JUMP_IF_FALSE)
+    pc = regs[pc->b] ? pc + 1 : code + pc->a;
+    VM_DISPATCH();
+  VM_CASE(RETURN) {
+    PBString result = std::move(regs[pc->a]);
+    release_registers();
+    return result;
+  }
+  VM_CASE(RETURN_EMPTY)
+    release_registers();
+    return PBString();
+
+#ifndef POIBOIC_VM_COMPUTED_GOTO
+    }
+  }
+#endif
+#undef VM_CASE
+#undef VM_DISPATCH
+}
+
+}  // namespace pbc
@@ -0,0 +1,52 @@
+/*
+Copyright 2021 Brian Coopersmith
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Runs a BytecodeProgram, with PBStrings from the runtime as values.
+
+#ifndef POIBOIC_VM_H_
+#define POIBOIC_VM_H_
+
+#include <vector>
+
+#include "bytecode.h"
+#include "poiboi_string.h"
+
+namespace pbc {
+
+class VirtualMachine {
+ public:
+  // program must outlive the VirtualMachine.
+  explicit VirtualMachine(const BytecodeProgram& program);
+
+  // Runs Main the way a compiled program's main() does, passing it arg if it
+  // takes an argument. arg may be null.
+  void RunMain(const char* arg);
+
+ private:
+  // Runs fn with its registers starting at registers_[base], where its
+  // arguments already are.
+  PBString Execute(const BytecodeFunction& fn, size_t base);
+
+  const BytecodeProgram& program_;
+  std::vector<PBString> constants_;
+  std::vector<PBString> globals_;
+  // The registers of every active call, innermost last.
+  std::vector<PBString> registers_;
+};
+
+}  // namespace pbc
+
+#endif  // #ifndef POIBOIC_VM_H_
@@ -1,18 +1,57 @@
 import os
+import shutil
 import subprocess
+import sys
+
+CC_DIR = './cc_src/'
+# Where the runtime library and the headers generated code needs end up.
+# poiboic looks here unless told otherwise with --runtime-dir.
+RUNTIME_DIR = './runtime/'
+RUNTIME_SRCS = ['poiboi_string.h', 'poiboi_string.cc', 'poiboi_module.h']
+# For processes loading programs built with poiboic --shared.
+HOST_SRCS = ['poiboi_host.h', 'poiboi_host.cc']
 
 def compile_poiboi():
   hdrs = []
   srcs = []
 
-  cc_dir = './cc_src/'
-  for fname in os.listdir(cc_dir):
-    if fname.endswith('_test.cc'):
+  for fname in os.listdir(CC_DIR):
+    if fname.endswith('_test.cc') or fname.endswith('_bench.cc') or fname in HOST_SRCS:
       continue
     if fname.endswith('.h'):
-      hdrs.append(cc_dir + fname)
+      hdrs.append(CC_DIR + fname)
     elif fname.endswith('.cc'):
-      srcs.append(cc_dir + fname)
-  subprocess.run(['g++', '-std=c++20', '-O2', '-Wall'] + srcs + ['-o', 'poiboic.exe'])
+      srcs.append(CC_DIR + fname)
+  runtime_dir = '-DPOIBOIC_RUNTIME_DIR="' + os.path.abspath(RUNTIME_DIR) + '"'
+  subprocess.run(['g++', '-std=c++20', '-O2', '-Wall', '-pthread', runtime_dir] + srcs +
+                 ['-o', 'poiboic.exe'])
+
+# -fPIC so the libraries can also be linked into shared objects.
+def compile_runtime_library(lib_name, extra_flags, archiver, src='poiboi_string.cc'):
+  obj = RUNTIME_DIR + src[:-len('.cc')] + '.o'
+  subprocess.run(['g++', '-std=c++20', '-Wall', '-fPIC', '-c', RUNTIME_DIR + src,
+                  '-o', obj] + extra_flags, check=True)
+  subprocess.run([archiver, 'rcs', RUNTIME_DIR + lib_name, obj], check=True)
+  os.remove(obj)
+
+DEBUG_FLAGS = ['-O2']
+# For programs poiboic generates at -O3 or with --release.
+RELEASE_FLAGS = ['-O3', '-DPOIBOI_RELEASE_', '-DNDEBUG']
+
+# Libraries of GCC's intermediate representation let runtime functions be
+# inlined into programs built with -flto. poiboic --release links the release
+# one, so it's always built; with lto, the debug one is too.
+def compile_runtime(lto):
+  os.makedirs(RUNTIME_DIR, exist_ok=True)
+  for fname in RUNTIME_SRCS + HOST_SRCS:
+    shutil.copy(CC_DIR + fname, RUNTIME_DIR + fname)
+  compile_runtime_library('libpoiboi_runtime.a', DEBUG_FLAGS, 'ar')
+  compile_runtime_library('libpoiboi_host.a', ['-O2'], 'ar', src='poiboi_host.cc')
+  compile_runtime_library('libpoiboi_runtime_release.a', RELEASE_FLAGS, 'ar')
+  compile_runtime_library('libpoiboi_runtime_release_lto.a', RELEASE_FLAGS + ['-flto'],
+                          'gcc-ar')
+  if lto:
+    compile_runtime_library('libpoiboi_runtime_lto.a', DEBUG_FLAGS + ['-flto'], 'gcc-ar')
 
+compile_runtime('--lto' in sys.argv[1:])
 compile_poiboi()